@@ -2,28 +2,64 @@
 
 #include <thread>
 #include <mutex>
+#include <chrono>
 #include <functional>
 #include <condition_variable>
 #include <deque>
+#include <optional>
 
 class BackgroundWorker {
 private:
   using Task = std::function<void()>;
+  using IdleTask = std::function<bool()>;
 
   std::mutex m_mutex;
-  std::thread m_thread;
   std::condition_variable m_signal;
   std::deque<Task> m_queue;
+  IdleTask m_idle_task;
+  std::chrono::milliseconds m_idle_delay{ };
+  bool m_idle_pending{ };
+  std::optional<std::chrono::steady_clock::time_point> m_idle_time;
   bool m_stop{ };
+  // initialized last, the thread accesses all other members
+  std::thread m_thread;
 
   void thread_func() noexcept {
     for (;;) {
       auto lock = std::unique_lock(m_mutex);
-      m_signal.wait(lock, [&]() { return m_stop || !m_queue.empty(); });
+      const auto ready = [&]() { return m_stop || !m_queue.empty(); };
+      if (m_idle_task && (m_idle_pending || m_idle_time)) {
+        const auto idle_time = (m_idle_pending ?
+          std::chrono::steady_clock::now() + m_idle_delay : *m_idle_time);
+        if (!m_signal.wait_until(lock, idle_time, ready)) {
+          // queue was empty for a while, do some idle work
+          auto idle_task = m_idle_task;
+          m_idle_time.reset();
+          lock.unlock();
+          auto pending = false;
+          try {
+            pending = idle_task();
+          }
+          catch (...) {
+          }
+          lock.lock();
+          m_idle_pending = pending;
+          continue;
+        }
+      }
+      else {
+        // also wake up when an idle task was set
+        m_signal.wait(lock, [&]() {
+          return ready() || (m_idle_task && (m_idle_pending || m_idle_time));
+        });
+        if (!ready())
+          continue;
+      }
       if (m_queue.empty())
         break;
       auto task = std::move(m_queue.front());
       m_queue.pop_front();
+      m_idle_pending = true;
       lock.unlock();
 
       try {
@@ -43,9 +79,31 @@ public:
     auto lock = std::unique_lock(m_mutex);
     m_stop = true;
     lock.unlock();
+    m_signal.notify_one();
     m_thread.join();
   }
 
+  // idle task is called when the queue was empty for the delay after
+  // a task was executed, it is called again while it returns true
+  void set_idle_task(IdleTask idle_task, std::chrono::milliseconds delay) {
+    auto lock = std::unique_lock(m_mutex);
+    m_idle_task = std::move(idle_task);
+    m_idle_delay = delay;
+    m_idle_pending = true;
+    m_idle_time.reset();
+    lock.unlock();
+    m_signal.notify_one();
+  }
+
+  // the idle task is also called at the time, when the queue is empty.
+  // Called by the idle task itself, which returned false
+  void schedule_idle_task(std::chrono::steady_clock::time_point time) {
+    auto lock = std::unique_lock(m_mutex);
+    m_idle_time = time;
+    lock.unlock();
+    m_signal.notify_one();
+  }
+
   template<typename F>
   void execute(F&& function) {
     auto lock = std::unique_lock(m_mutex);
@@ -0,0 +1,93 @@
+
+#include "BlobStore.h"
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+namespace {
+  const auto blob_store_directory_name = ".blobs";
+  const auto min_hash_length = size_t{ 32 };
+  const auto max_hash_length = size_t{ 128 };
+
+  bool is_valid_hash(std::string_view hash) {
+    return (hash.size() >= min_hash_length && hash.size() <= max_hash_length &&
+      std::all_of(hash.begin(), hash.end(), [](char c) {
+        return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'));
+      }));
+  }
+} // namespace
+
+std::filesystem::path get_blob_store_path(
+    const std::filesystem::path& library_root) {
+  return library_root / blob_store_directory_name;
+}
+
+std::vector<BlobReference> get_blob_references(const ArchiveReader& reader) {
+  const auto data = reader.read("blobs");
+  auto blobs = as_string_view(data);
+  auto references = std::vector<BlobReference>();
+  while (!blobs.empty()) {
+    const auto end = blobs.find('\n');
+    auto line = trim(blobs.substr(0, end));
+    blobs.remove_prefix(end == std::string_view::npos ? blobs.size() : end + 1);
+
+    const auto space = line.find(' ');
+    if (space == std::string_view::npos)
+      continue;
+    const auto hash = line.substr(0, space);
+    const auto url = trim(line.substr(space + 1));
+    if (is_valid_hash(hash) && !url.empty())
+      references.push_back({ std::string(hash), std::string(url) });
+  }
+  return references;
+}
+
+std::filesystem::path get_blob_path(const std::filesystem::path& blob_store,
+    std::string_view hash) {
+  if (!is_valid_hash(hash))
+    return { };
+  // do not put all blobs in a single directory
+  return blob_store / std::string(hash.substr(0, 2)) / std::string(hash);
+}
+
+ByteVector read_blob(const std::filesystem::path& blob_path) {
+  auto file = std::ifstream(blob_path, std::ios::binary | std::ios::in);
+  if (!file.good())
+    return { };
+  file.seekg(0, std::ios::end);
+  const auto size = static_cast<size_t>(file.tellg());
+  file.seekg(0, std::ios::beg);
+  auto data = ByteVector(size);
+  file.read(reinterpret_cast<char*>(data.data()),
+    static_cast<std::streamsize>(size));
+  if (!file.good())
+    return { };
+  return data;
+}
+
+void remove_blobs(const std::filesystem::path& blob_store,
+    const std::vector<std::filesystem::path>& archives,
+    const std::vector<std::string>& hashes, std::chrono::seconds grace_period) {
+  auto unreferenced = std::set<std::string>(hashes.begin(), hashes.end());
+  for (const auto& archive : archives) {
+    auto reader = ArchiveReader();
+    if (!reader.open(archive))
+      return;
+    for (const auto& reference : get_blob_references(reader))
+      unreferenced.erase(reference.hash);
+    if (unreferenced.empty())
+      return;
+  }
+
+  const auto now = std::filesystem::file_time_type::clock::now();
+  auto error = std::error_code{ };
+  for (const auto& hash : unreferenced) {
+    const auto path = get_blob_path(blob_store, hash);
+    if (path.empty())
+      continue;
+    const auto time = std::filesystem::last_write_time(path, error);
+    if (error || now - time < grace_period)
+      continue;
+    std::filesystem::remove(path, error);
+  }
+}
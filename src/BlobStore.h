@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common.h"
+#include "libs/webrecorder/src/Archive.h"
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// a webrecorder started with --blob-store does not store the responses in
+// the archive, but once in the library's blob store, addressed by the hash
+// of their content. The archive's "blobs" file lists the references, one
+// "<hash> <url>" per line. Reused blobs get their modification time updated.
+struct BlobReference {
+  std::string hash;
+  std::string url;
+};
+
+std::filesystem::path get_blob_store_path(
+  const std::filesystem::path& library_root);
+
+std::vector<BlobReference> get_blob_references(const ArchiveReader& reader);
+
+// returns an empty path, when the hash is not valid
+std::filesystem::path get_blob_path(const std::filesystem::path& blob_store,
+  std::string_view hash);
+
+ByteVector read_blob(const std::filesystem::path& blob_path);
+
+// removes the blobs, unless they are referenced by one of the archives or
+// were recently used by a recording, which did not finish yet. Nothing is
+// removed, when one of the archives can not be read
+void remove_blobs(const std::filesystem::path& blob_store,
+  const std::vector<std::filesystem::path>& archives,
+  const std::vector<std::string>& hashes, std::chrono::seconds grace_period);
@@ -3,28 +3,24 @@
 #include "sqlite.h"
 #include "Indexing.h"
 #include "libs/entities/entities.h"
+#include "zlib.h"
 #include <array>
+#include <map>
+#include <cstring>
 #include <algorithm>
 #include <unordered_set>
 #include <utility>
 
 namespace {
-  std::string concatenate(std::vector<std::string_view> texts, std::string_view separator) {
-    auto size = size_t{ };
-    for (const auto& text : texts)
-      size += text.size() + separator.size();
-    auto total = std::string();
-    total.reserve(size);
-    for (const auto& text : texts) {
-      if (!total.empty() &&
-          !text.empty() &&
-          !is_punct(text.front()))
-        total.insert(end(total), begin(separator), end(separator));
-      total.append(text);
-    }
-    return total;
+  void append(std::string& total, std::string_view text, std::string_view separator) {
+    if (!total.empty() &&
+        !text.empty() &&
+        !is_punct(text.front()))
+      total.append(separator);
+    total.append(text);
   }
 
+
   std::string decode_html_entities(std::string text) {
     text.resize(decode_html_entities_utf8(text.data(), nullptr));
     return text;
@@ -37,124 +33,936 @@ namespace {
       [](char a, char b) { return (a == ' ' && b == ' '); }), end(text));
     return text;
   }
+
+  // texts are stored zlib compressed, prefixed with their uncompressed size,
+  // short texts are stored as they are
+  const auto min_compress_text_size = size_t{ 128 };
+  const auto search_cache_capacity = size_t{ 32 };
+  const auto search_progress_instructions = 1000;
+  const auto max_ranked_matches = size_t{ 10000 };
+  const auto max_search_candidates = size_t{ 1000 };
+
+  bool store_compressed(std::string_view text) {
+    return (text.size() >= min_compress_text_size);
+  }
+
+  ByteVector compress_text(std::string_view text) {
+    const auto size = static_cast<uint32_t>(text.size());
+    auto length = compressBound(size);
+    auto data = ByteVector(sizeof(size) + length);
+    std::memcpy(data.data(), &size, sizeof(size));
+    if (compress2(reinterpret_cast<Bytef*>(data.data() + sizeof(size)), &length,
+          reinterpret_cast<const Bytef*>(text.data()), size,
+          Z_DEFAULT_COMPRESSION) != Z_OK)
+      throw std::runtime_error("compressing text failed");
+    data.resize(sizeof(size) + length);
+    return data;
+  }
+
+  std::string uncompress_text(nonstd::span<const std::byte> data) {
+    auto size = uint32_t{ };
+    if (data.size() < sizeof(size))
+      throw std::runtime_error("invalid compressed text");
+    std::memcpy(&size, data.data(), sizeof(size));
+    auto text = std::string(size, ' ');
+    auto length = uLongf{ size };
+    if (uncompress(reinterpret_cast<Bytef*>(text.data()), &length,
+          reinterpret_cast<const Bytef*>(data.data() + sizeof(size)),
+          static_cast<uLong>(data.size() - sizeof(size))) != Z_OK ||
+        length != size)
+      throw std::runtime_error("uncompressing text failed");
+    return text;
+  }
+
+  void truncate_text(std::string& text, size_t max_length) {
+    if (text.size() <= max_length)
+      return;
+    // do not split UTF-8 sequences
+    auto length = max_length;
+    while (length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80)
+      --length;
+    text.resize(length);
+  }
+
+  void bind_text(sqlite::Statement& statement, int index, std::string_view text) {
+    if (store_compressed(text)) {
+      const auto data = compress_text(text);
+      statement.bind(index, data);
+    }
+    else
+      statement.bind(index, text);
+  }
+
+  void register_functions(sqlite::Database& db) {
+    db.create_function("compress_text", 1, [](sqlite::FunctionContext& context) {
+      if (context.argument_type(0) != sqlite::Type::Text)
+        return context.result_null();
+      const auto text = context.argument_text(0);
+      if (store_compressed(text)) {
+        const auto data = compress_text(text);
+        context.result(data);
+      }
+      else
+        context.result(text);
+    });
+
+    db.create_function("uncompress_text", 1, [](sqlite::FunctionContext& context) {
+      switch (context.argument_type(0)) {
+        case sqlite::Type::Blob:
+          return context.result(uncompress_text(context.argument_blob(0)));
+        case sqlite::Type::Text:
+          return context.result(context.argument_text(0));
+        default:
+          return context.result_null();
+      }
+    });
+
+    db.create_function("get_hostname", 1, [](sqlite::FunctionContext& context) {
+      if (context.argument_type(0) != sqlite::Type::Text)
+        return context.result_null();
+      context.result(get_hostname(context.argument_text(0)));
+    });
+  }
+
+  std::string get_filter_key(const SearchFilter& filter) {
+    const auto to_string = [](const std::optional<int64_t>& value) {
+      return (value ? std::to_string(*value) : std::string());
+    };
+    return filter.folder.value_or("") + "|" +
+           filter.hostname.value_or("") + "|" +
+           to_string(filter.time_from) + "|" +
+           to_string(filter.time_to);
+  }
+
+  std::string get_rank_function(const SearchWeights& weights) {
+    return "bm25(" +
+      std::to_string(weights.title) + ", " +
+      std::to_string(weights.heading) + ", " +
+      std::to_string(weights.text) + ", " +
+      std::to_string(weights.navigation) + ")";
+  }
+
+  // selects an archive or all archives within a directory
+  const auto archive_path_condition = "(path = ?1 OR (path >= ?1 || '/' AND path < ?1 || '0'))";
+
+  int64_t get_file_time(const std::filesystem::path& path) {
+    return static_cast<int64_t>(
+      std::filesystem::last_write_time(path).time_since_epoch().count());
+  }
+
+  // restricts page_contents aliased as c, parameters are bound by bind_filter
+  std::string get_filter_condition(const SearchFilter& filter) {
+    auto condition = std::string(
+      " AND c.uid NOT IN (SELECT uid FROM archives WHERE deleted)");
+    if (filter.folder)
+      condition += " AND c.uid IN (SELECT uid FROM archives "
+                   "WHERE path >= ? AND path < ?)";
+    if (filter.hostname)
+      condition += " AND c.hostname = ?";
+    if (filter.time_from)
+      condition += " AND c.time >= ?";
+    if (filter.time_to)
+      condition += " AND c.time < ?";
+    return condition;
+  }
+
+  int bind_filter(sqlite::Statement& statement, int index, const SearchFilter& filter) {
+    if (filter.folder) {
+      // select all paths within folder, '0' is the successor of '/'
+      statement.bind(index++, *filter.folder + "/");
+      statement.bind(index++, *filter.folder + "0");
+    }
+    if (filter.hostname)
+      statement.bind(index++, *filter.hostname);
+    if (filter.time_from)
+      statement.bind(index++, *filter.time_from);
+    if (filter.time_to)
+      statement.bind(index++, *filter.time_to);
+    return index;
+  }
 } // namespace
 
 Database::Database(const std::filesystem::path& path)
-  : m_db(new sqlite::Database()) {
+  : m_library_root(path.parent_path()),
+    m_db(new sqlite::Database()),
+    m_search_cache(search_cache_capacity) {
   m_db->open(path_to_utf8(path));
+  register_functions(*m_db);
+  migrate_schema();
+}
+
+bool Database::schema_object_exists(std::string_view type, std::string_view name) {
+  auto select = m_db->prepare(R"(
+    SELECT 1 FROM sqlite_master WHERE type = ? AND name = ?
+  )");
+  select.bind(0, type);
+  select.bind(1, name);
+  auto result = select.query();
+  return result.step();
+}
+
+int Database::get_schema_version() {
+  auto select = m_db->prepare("PRAGMA user_version");
+  auto result = select.query();
+  return (result.step() ? result.to_int(0) : 0);
+}
+
+void Database::migrate_schema() {
+  // the schema version is the number of applied migrations,
+  // append new migrations, never modify existing ones
+  using Migration = void(Database::*)();
+  static const auto s_migrations = std::array<Migration, 10>{
+    &Database::migrate_to_compressed_contents,
+    &Database::migrate_to_unindexed_metadata,
+    &Database::migrate_to_idle_merging,
+    &Database::migrate_to_page_metadata,
+    &Database::migrate_to_archive_paths,
+    &Database::migrate_to_heading_column,
+    &Database::migrate_to_indexing_statistics,
+    &Database::migrate_to_archive_file_state,
+    &Database::migrate_to_blob_references,
+    &Database::migrate_to_indexing_version,
+  };
+  const auto current_version = get_schema_version();
+  const auto latest_version = static_cast<int>(s_migrations.size());
+  if (current_version > latest_version)
+    throw std::runtime_error("index database version not supported");
+  if (current_version == latest_version)
+    return;
+
+  for (auto version = current_version; version < latest_version; ++version) {
+    m_db->execute("BEGIN");
+    try {
+      (this->*s_migrations[static_cast<size_t>(version)])();
+      m_db->execute("PRAGMA user_version = " + std::to_string(version + 1));
+      m_db->execute("COMMIT");
+    }
+    catch (...) {
+      m_db->execute("ROLLBACK");
+      throw;
+    }
+  }
+  m_db->execute("VACUUM");
+}
+
+void Database::migrate_to_compressed_contents() {
+  // page contents are stored compressed in a regular table, the FTS5 index
+  // only references them through a view, which uncompresses them on demand.
+  // databases before versioning store the contents in the FTS5 table
+  const auto legacy = schema_object_exists("table", "pages_content");
+  if (legacy)
+    m_db->execute("ALTER TABLE pages RENAME TO legacy_pages");
+
+  m_db->execute(R"(
+    CREATE TABLE IF NOT EXISTS page_contents (
+      id INTEGER PRIMARY KEY,
+      uid INTEGER, url TEXT, title TEXT, text, text_low
+    )
+  )");
+  m_db->execute(R"(
+    CREATE INDEX IF NOT EXISTS page_contents_uid ON page_contents (uid)
+  )");
+  m_db->execute(R"(
+    CREATE VIEW IF NOT EXISTS page_texts AS
+      SELECT id, uid, url, title,
+        uncompress_text(text) AS text,
+        uncompress_text(text_low) AS text_low
+      FROM page_contents
+  )");
   m_db->execute(R"(
     CREATE VIRTUAL TABLE IF NOT EXISTS pages USING fts5 (
       uid, url, title, text, text_low,
+      content = 'page_texts',
+      content_rowid = 'id',
       tokenize = 'unicode61 remove_diacritics 2',
       prefix = '2 3'
     )
   )");
+  m_db->execute(R"(
+    CREATE TRIGGER IF NOT EXISTS page_contents_delete
+    AFTER DELETE ON page_contents BEGIN
+      INSERT INTO pages
+        (pages, rowid, uid, url, title, text, text_low)
+      VALUES
+        ('delete', old.id, old.uid, old.url, old.title,
+         uncompress_text(old.text), uncompress_text(old.text_low));
+    END
+  )");
+
+  if (legacy) {
+    m_db->execute(R"(
+      INSERT INTO page_contents
+        (uid, url, title, text, text_low)
+      SELECT uid, url, title, compress_text(text), compress_text(text_low)
+      FROM legacy_pages
+    )");
+    m_db->execute("DROP TABLE legacy_pages");
+    m_db->execute("INSERT INTO pages (pages) VALUES ('rebuild')");
+  }
+}
+
+void Database::migrate_to_unindexed_metadata() {
+  // uid and url are no longer part of the FTS5 index,
+  // they are joined from page_contents by rowid
+  m_db->execute("DROP TRIGGER page_contents_delete");
+  m_db->execute("DROP TABLE pages");
+  m_db->execute("DROP VIEW page_texts");
+  m_db->execute(R"(
+    CREATE VIEW page_texts AS
+      SELECT id, title,
+        uncompress_text(text) AS text,
+        uncompress_text(text_low) AS text_low
+      FROM page_contents
+  )");
+  m_db->execute(R"(
+    CREATE VIRTUAL TABLE pages USING fts5 (
+      title, text, text_low,
+      content = 'page_texts',
+      content_rowid = 'id',
+      tokenize = 'unicode61 remove_diacritics 2',
+      prefix = '2 3'
+    )
+  )");
+  m_db->execute(R"(
+    CREATE TRIGGER page_contents_delete
+    AFTER DELETE ON page_contents BEGIN
+      INSERT INTO pages
+        (pages, rowid, title, text, text_low)
+      VALUES
+        ('delete', old.id, old.title,
+         uncompress_text(old.text), uncompress_text(old.text_low));
+    END
+  )");
+  m_db->execute("INSERT INTO pages (pages) VALUES ('rebuild')");
+}
+
+void Database::migrate_to_idle_merging() {
+  // let merges triggered by merge_index already combine two segments
+  m_db->execute("INSERT INTO pages (pages, rank) VALUES ('usermerge', 2)");
+}
+
+void Database::migrate_to_page_metadata() {
+  // hostname and archive time are stored for faceting search results,
+  // the time of already indexed pages is unknown until they are reindexed
+  m_db->execute("ALTER TABLE page_contents ADD COLUMN hostname TEXT");
+  m_db->execute("ALTER TABLE page_contents ADD COLUMN time INTEGER");
+  m_db->execute("UPDATE page_contents SET hostname = get_hostname(url)");
+}
+
+void Database::migrate_to_archive_paths() {
+  // archive paths relative to the library root allow to restrict a
+  // search to a bookmark folder, they are set when they are reindexed
+  m_db->execute(R"(
+    CREATE TABLE archives (
+      uid INTEGER PRIMARY KEY,
+      path TEXT
+    )
+  )");
+  m_db->execute("CREATE INDEX archives_path ON archives (path)");
+  m_db->execute("CREATE INDEX page_contents_hostname ON page_contents (hostname)");
+  m_db->execute("CREATE INDEX page_contents_time ON page_contents (time)");
+}
+
+void Database::migrate_to_heading_column() {
+  // headings are indexed in their own column, so they can be weighted,
+  // they stay part of the text of already indexed pages until reindexed
+  m_db->execute("ALTER TABLE page_contents ADD COLUMN heading");
+  m_db->execute("DROP TRIGGER page_contents_delete");
+  m_db->execute("DROP TABLE pages");
+  m_db->execute("DROP VIEW page_texts");
+  m_db->execute(R"(
+    CREATE VIEW page_texts AS
+      SELECT id, title,
+        uncompress_text(heading) AS heading,
+        uncompress_text(text) AS text,
+        uncompress_text(text_low) AS text_low
+      FROM page_contents
+  )");
+  m_db->execute(R"(
+    CREATE VIRTUAL TABLE pages USING fts5 (
+      title, heading, text, text_low,
+      content = 'page_texts',
+      content_rowid = 'id',
+      tokenize = 'unicode61 remove_diacritics 2',
+      prefix = '2 3'
+    )
+  )");
+  m_db->execute(R"(
+    CREATE TRIGGER page_contents_delete
+    AFTER DELETE ON page_contents BEGIN
+      INSERT INTO pages
+        (pages, rowid, title, heading, text, text_low)
+      VALUES
+        ('delete', old.id, old.title, uncompress_text(old.heading),
+         uncompress_text(old.text), uncompress_text(old.text_low));
+    END
+  )");
+  m_db->execute("INSERT INTO pages (pages) VALUES ('rebuild')");
+
+  // configuration was dropped with the table
+  migrate_to_idle_merging();
+}
+
+void Database::migrate_to_indexing_statistics() {
+  // pages which were skipped or truncated by the indexing policy
+  m_db->execute(R"(
+    ALTER TABLE archives ADD COLUMN skipped_pages INTEGER NOT NULL DEFAULT 0
+  )");
+  m_db->execute(R"(
+    ALTER TABLE archives ADD COLUMN skipped_bytes INTEGER NOT NULL DEFAULT 0
+  )");
+  m_db->execute(R"(
+    ALTER TABLE archives ADD COLUMN truncated_pages INTEGER NOT NULL DEFAULT 0
+  )");
+}
+
+void Database::migrate_to_archive_file_state() {
+  // size and modification time of the indexed archive file allow to update
+  // the path of a moved archive without reindexing it. Archives moved to the
+  // trash are marked deleted, so they can be restored
+  m_db->execute("ALTER TABLE archives ADD COLUMN file_size INTEGER");
+  m_db->execute("ALTER TABLE archives ADD COLUMN file_time INTEGER");
+  m_db->execute(R"(
+    ALTER TABLE archives ADD COLUMN deleted INTEGER NOT NULL DEFAULT 0
+  )");
+  m_db->execute("CREATE INDEX archives_deleted ON archives (uid) WHERE deleted");
+}
+
+void Database::migrate_to_blob_references() {
+  // a blob is referenced as long as an archive referencing it is indexed,
+  // also while it is in the trash
+  m_db->execute(R"(
+    CREATE TABLE blob_references (
+      uid INTEGER NOT NULL,
+      hash TEXT NOT NULL,
+      PRIMARY KEY (uid, hash)
+    ) WITHOUT ROWID
+  )");
+  m_db->execute("CREATE INDEX blob_references_hash ON blob_references (hash)");
+}
+
+void Database::migrate_to_indexing_version() {
+  // a moved archive is only rekeyed, when it was indexed the same way
+  m_db->execute("ALTER TABLE archives ADD COLUMN indexing_version INTEGER");
 }
 
 Database::~Database() = default;
 
-void Database::update_index(const std::filesystem::path& filename) {
+std::string Database::get_relative_path(const std::filesystem::path& path) const {
+  const auto relative = path.lexically_relative(m_library_root);
+  return (relative == "." ? std::string() : relative.generic_u8string());
+}
+
+bool Database::try_rekey_archive(int64_t uid, const std::string& path,
+    int64_t file_size, int64_t file_time, int64_t indexing_version) {
+  auto lock = std::lock_guard(m_db_mutex);
+  auto update = m_db->prepare(R"(
+    UPDATE archives SET path = ?, deleted = 0
+    WHERE uid = ? AND file_size = ? AND file_time = ? AND indexing_version = ?
+  )");
+  update.bind(0, path);
+  update.bind(1, uid);
+  update.bind(2, file_size);
+  update.bind(3, file_time);
+  update.bind(4, indexing_version);
+  if (!update.execute())
+    return false;
+  m_search_cache.clear();
+  return true;
+}
+
+std::vector<std::string> Database::replace_blob_references(int64_t uid,
+    const std::vector<BlobReference>& references) {
+  auto lock = std::lock_guard(m_db_mutex);
+  auto previous = std::set<std::string>();
+  auto select = m_db->prepare("SELECT hash FROM blob_references WHERE uid = ?");
+  select.bind(0, uid);
+  for (auto result = select.query(); result.step(); )
+    previous.emplace(result.to_text(0));
+  if (previous.empty() && references.empty())
+    return { };
+
+  m_db->execute("BEGIN");
+  try {
+    auto clear = m_db->prepare("DELETE FROM blob_references WHERE uid = ?");
+    clear.bind(0, uid);
+    clear.execute();
+
+    auto insert = m_db->prepare(R"(
+      INSERT OR IGNORE INTO blob_references (uid, hash) VALUES (?, ?)
+    )");
+    for (const auto& reference : references) {
+      insert.bind(0, uid);
+      insert.bind(1, reference.hash);
+      insert.execute();
+    }
+    auto released = get_unreferenced_blobs(previous);
+    m_db->execute("COMMIT");
+    return released;
+  }
+  catch (...) {
+    m_db->execute("ROLLBACK");
+    throw;
+  }
+}
+
+std::vector<std::string> Database::get_unreferenced_blobs(
+    const std::set<std::string>& hashes) {
+  auto unreferenced = std::vector<std::string>();
+  auto select = m_db->prepare(R"(
+    SELECT 1 FROM blob_references WHERE hash = ? LIMIT 1
+  )");
+  for (const auto& hash : hashes) {
+    select.bind(0, hash);
+    if (!select.query().step())
+      unreferenced.push_back(hash);
+  }
+  return unreferenced;
+}
+
+int64_t Database::get_blob_reference_count(std::string_view hash) {
+  auto lock = std::lock_guard(m_db_mutex);
+  auto select = m_db->prepare(R"(
+    SELECT COUNT(*) FROM blob_references WHERE hash = ?
+  )");
+  select.bind(0, hash);
+  auto result = select.query();
+  return (result.step() ? result.to_int64(0) : 0);
+}
+
+std::vector<std::string> Database::record_blob_references(
+    const std::filesystem::path& filename) {
+  auto reader = ArchiveReader();
+  if (!reader.open(filename))
+    throw std::runtime_error("reading archive failed");
+  const auto references = get_blob_references(reader);
+  if (references.empty())
+    return { };
+
+  // the archive row is required for removing the references,
+  // it is replaced when the archive is indexed
+  const auto uid = get_archive_uid(reader);
+  {
+    auto lock = std::lock_guard(m_db_mutex);
+    auto insert = m_db->prepare(R"(
+      INSERT OR IGNORE INTO archives (uid, path) VALUES (?, ?)
+    )");
+    insert.bind(0, uid);
+    insert.bind(1, get_relative_path(filename));
+    insert.execute();
+  }
+  return replace_blob_references(uid, references);
+}
+
+std::vector<std::string> Database::update_index(
+    const std::filesystem::path& filename, const IndexingPolicy& policy,
+    bool reindex) {
   auto reader = ArchiveReader();
   if (!reader.open(filename))
     throw std::runtime_error("indexing archive failed");
 
+  // an unmodified archive was only moved, when it is already indexed
+  // with the same policy
+  const auto uid = get_archive_uid(reader);
+  const auto path = get_relative_path(filename);
+  auto error = std::error_code{ };
+  const auto file_size = static_cast<int64_t>(std::filesystem::file_size(filename, error));
+  const auto file_time = get_file_time(filename);
+  const auto indexing_version = static_cast<int64_t>(get_indexing_version(policy));
+  if (!reindex &&
+      try_rekey_archive(uid, path, file_size, file_time, indexing_version))
+    return { };
+
   auto clear = sqlite::Statement();
+  auto insert_archive = sqlite::Statement();
+  auto update_archive = sqlite::Statement();
   auto insert = sqlite::Statement();
+  auto insert_index = sqlite::Statement();
   {
     auto lock = std::lock_guard(m_db_mutex);
     clear = m_db->prepare(R"(
-      DELETE FROM pages WHERE uid = ?
+      DELETE FROM page_contents WHERE uid = ?
+    )");
+    insert_archive = m_db->prepare(R"(
+      INSERT OR REPLACE INTO archives
+        (uid, path, file_size, file_time, indexing_version)
+      VALUES
+        (?, ?, ?, ?, ?)
+    )");
+    update_archive = m_db->prepare(R"(
+      UPDATE archives SET
+        skipped_pages = ?, skipped_bytes = ?, truncated_pages = ?
+      WHERE uid = ?
     )");
     insert = m_db->prepare(R"(
+      INSERT INTO page_contents
+        (uid, url, title, heading, text, text_low, hostname, time)
+      VALUES
+        (?, ?, ?, ?, ?, ?, ?, ?)
+    )");
+    insert_index = m_db->prepare(R"(
       INSERT INTO pages
-        (uid, url, title, text, text_low)
+        (rowid, title, heading, text, text_low)
       VALUES
         (?, ?, ?, ?, ?)
     )");
   }
 
-  const auto uid = get_archive_uid(reader);
+  // also when the policy skips all documents, the old pages are removed
+  // and the archive is recorded as indexed
+  {
+    auto lock = std::lock_guard(m_db_mutex);
+    clear.bind(0, uid);
+    clear.execute();
+    insert_archive.bind(0, uid);
+    insert_archive.bind(1, path);
+    insert_archive.bind(2, file_size);
+    insert_archive.bind(3, file_time);
+    insert_archive.bind(4, indexing_version);
+    insert_archive.execute();
+    m_search_cache.clear();
+  }
 
-  auto deleted = false;
-  for_each_archive_html(reader, [&](ArchiveHtml html) {
-    if (!std::exchange(deleted, true)) {
-      auto lock = std::lock_guard(m_db_mutex);
-      clear.bind(0, uid);
-      clear.execute();
-    }
-    auto title = std::string_view();
-    auto text = std::vector<std::string_view>();
-    auto text_low = std::vector<std::string_view>();
-    for_each_html_text(html.html,
+  auto released = replace_blob_references(uid, get_blob_references(reader));
+
+  auto truncated_pages = int64_t{ };
+  const auto statistics = for_each_archive_document(reader, policy,
+      get_blob_store_path(m_library_root), [&](ArchiveDocument document) {
+    auto title = std::string();
+    auto heading = std::string();
+    auto text = std::string();
+    auto text_low = std::string();
+    extract_document_text(document, policy.max_extraction_time,
       [&](std::string_view string, HtmlSection section) {
         switch (section) {
           case HtmlSection::heading:
+            append(heading, string, " | ");
+            break;
           case HtmlSection::content:
-            text.push_back(string);
+            append(text, string, " ");
             break;
           case HtmlSection::navigation:
-            text_low.push_back(string);
+            append(text_low, string, " | ");
             break;
           case HtmlSection::title:
             title = string;
             break;
         }
       });
-    if (!title.empty() && (!text.empty() || !text_low.empty())) {
+    if (!title.empty() && (!heading.empty() || !text.empty() || !text_low.empty())) {
+      const auto title_string = normalize_space(decode_html_entities(std::move(title)));
+      auto heading_string = normalize_space(decode_html_entities(std::move(heading)));
+      auto text_string = normalize_space(decode_html_entities(std::move(text)));
+      auto text_low_string = normalize_space(decode_html_entities(std::move(text_low)));
+      if (heading_string.size() + text_string.size() +
+          text_low_string.size() > policy.max_text_length) {
+        // keep text, then headings, then navigation within limit
+        truncate_text(text_string, policy.max_text_length);
+        truncate_text(heading_string, policy.max_text_length - text_string.size());
+        truncate_text(text_low_string, policy.max_text_length -
+          text_string.size() - heading_string.size());
+        ++truncated_pages;
+      }
+
       auto lock = std::lock_guard(m_db_mutex);
       insert.bind(0, uid);
-      insert.bind(1, html.url);
-      insert.bind(2, normalize_space(decode_html_entities(std::string(title))));
-      insert.bind(3, normalize_space(decode_html_entities(concatenate(text, " "))));
-      insert.bind(4, normalize_space(decode_html_entities(concatenate(text_low, " | "))));
+      insert.bind(1, document.url);
+      insert.bind(2, title_string);
+      bind_text(insert, 3, heading_string);
+      bind_text(insert, 4, text_string);
+      bind_text(insert, 5, text_low_string);
+      insert.bind(6, get_hostname(document.url));
+      insert.bind(7, static_cast<int64_t>(document.modification_time));
       insert.execute();
+
+      insert_index.bind(0, m_db->last_insert_rowid());
+      insert_index.bind(1, title_string);
+      insert_index.bind(2, heading_string);
+      insert_index.bind(3, text_string);
+      insert_index.bind(4, text_low_string);
+      insert_index.execute();
+      m_search_cache.clear();
     }
   });
+
+  auto lock = std::lock_guard(m_db_mutex);
+  update_archive.bind(0, static_cast<int64_t>(statistics.skipped_pages));
+  update_archive.bind(1, static_cast<int64_t>(statistics.skipped_bytes));
+  update_archive.bind(2, truncated_pages);
+  update_archive.bind(3, uid);
+  update_archive.execute();
+  return released;
 }
 
-void Database::execute_search(std::string_view query,
-    bool highlight, int snippet_size, int max_count,
-    const std::function<void(SearchResult)>& match_callback) {
+void Database::move_archives(const std::vector<std::pair<
+    std::filesystem::path, std::filesystem::path>>& moved_paths, bool deleted) {
   auto lock = std::lock_guard(m_db_mutex);
+  auto changed = false;
+  m_db->execute("BEGIN");
+  try {
+    auto update = m_db->prepare(std::string(R"(
+      UPDATE archives SET
+        path = CASE WHEN path = ?1 THEN ?2
+               ELSE ?3 || substr(path, length(?1) + 2) END,
+        deleted = ?4
+      WHERE )") + archive_path_condition);
+    for (const auto& [from, to] : moved_paths) {
+      const auto to_path = get_relative_path(to);
+      update.bind(0, get_relative_path(from));
+      update.bind(1, to_path);
+      update.bind(2, to_path.empty() ? to_path : to_path + "/");
+      update.bind(3, deleted ? 1 : 0);
+      changed |= (update.execute() != 0);
+    }
+    m_db->execute("COMMIT");
+  }
+  catch (...) {
+    m_db->execute("ROLLBACK");
+    throw;
+  }
+  if (changed)
+    m_search_cache.clear();
+}
 
-  auto added = std::unordered_set<std::string_view>();
-  for (auto [column_index, column_name] : {
-      std::pair{ 3, "text" },
-      std::pair{ 4, "text_low" },
-    }) {
+std::vector<std::string> Database::remove_archives(
+    const std::vector<std::filesystem::path>& paths) {
+  auto lock = std::lock_guard(m_db_mutex);
+  auto released = std::vector<std::string>();
+  m_db->execute("BEGIN");
+  try {
+    auto select_blobs = m_db->prepare(std::string(R"(
+      SELECT DISTINCT hash FROM blob_references WHERE uid IN (
+        SELECT uid FROM archives WHERE )") + archive_path_condition + ")");
+    auto delete_blobs = m_db->prepare(std::string(R"(
+      DELETE FROM blob_references WHERE uid IN (
+        SELECT uid FROM archives WHERE )") + archive_path_condition + ")");
+    auto delete_pages = m_db->prepare(std::string(R"(
+      DELETE FROM page_contents WHERE uid IN (
+        SELECT uid FROM archives WHERE )") + archive_path_condition + ")");
+    auto delete_archives = m_db->prepare(
+      std::string("DELETE FROM archives WHERE ") + archive_path_condition);
 
-    if (max_count <= 0)
-      return;
+    auto hashes = std::set<std::string>();
+    for (const auto& path : paths) {
+      const auto archive_path = get_relative_path(path);
+      select_blobs.bind(0, archive_path);
+      for (auto result = select_blobs.query(); result.step(); )
+        hashes.emplace(result.to_text(0));
+
+      delete_blobs.bind(0, archive_path);
+      delete_blobs.execute();
+      delete_pages.bind(0, archive_path);
+      delete_pages.execute();
+      delete_archives.bind(0, archive_path);
+      delete_archives.execute();
+    }
+    released = get_unreferenced_blobs(hashes);
+    m_db->execute("COMMIT");
+  }
+  catch (...) {
+    m_db->execute("ROLLBACK");
+    throw;
+  }
+  m_search_cache.clear();
+  return released;
+}
+
+bool Database::merge_index() {
+  // merge some segments, returns whether there is more work to do
+  auto lock = std::lock_guard(m_db_mutex);
+  const auto total_changes = m_db->total_changes();
+  m_db->execute("INSERT INTO pages (pages, rank) VALUES ('merge', 256)");
+  return (m_db->total_changes() - total_changes >= 2);
+}
 
-    const auto format = R"(
-      SELECT uid, url, title, snippet(pages, %i, %s, %s, '', %i)
-      FROM pages
-      WHERE %s MATCH ?
-      ORDER BY RANK
-      LIMIT %i
-    )";
-    auto buffer = std::array<char, 256>();
-    std::snprintf(buffer.data(), buffer.size(), format,
-      column_index,
-      highlight ? "'<b>'" : "''",
-      highlight ? "'</b>'" : "''",
-      snippet_size,
-      column_name,
-      max_count);
-
-    auto select = m_db->prepare(buffer.data());
-    select.bind(0, query);
+void Database::optimize_index() {
+  auto lock = std::lock_guard(m_db_mutex);
+  m_db->execute("INSERT INTO pages (pages) VALUES ('optimize')");
+}
+
+void Database::vacuum_index() {
+  auto lock = std::lock_guard(m_db_mutex);
+  m_db->execute("VACUUM");
+}
+
+IndexMetrics Database::get_metrics() {
+  auto lock = std::lock_guard(m_db_mutex);
+  const auto query_int64 = [&](std::string_view sql) {
+    auto select = m_db->prepare(sql);
     auto result = select.query();
-    while (result.step()) {
-      const auto uid = result.to_int64(0);
-      const auto url = result.to_text(1);
-      const auto title = result.to_text(2);
-      const auto snippet = result.to_text(3);
-      if (!added.count(url)) {
-        added.insert(url);
-        match_callback({ uid, url, title, snippet });
-        --max_count;
-      }
+    return (result.step() ? result.to_int64(0) : 0);
+  };
+  auto metrics = IndexMetrics{ };
+  metrics.page_count = query_int64("SELECT COUNT(*) FROM page_contents");
+  metrics.segment_count = query_int64("SELECT COUNT(DISTINCT segid) FROM pages_idx");
+  metrics.skipped_page_count = query_int64("SELECT SUM(skipped_pages) FROM archives");
+  metrics.skipped_byte_count = query_int64("SELECT SUM(skipped_bytes) FROM archives");
+  metrics.truncated_page_count = query_int64("SELECT SUM(truncated_pages) FROM archives");
+  metrics.database_size = query_int64(R"(
+    SELECT page_count * page_size
+    FROM pragma_page_count(), pragma_page_size()
+  )");
+  return metrics;
+}
+
+std::optional<SearchResults> Database::execute_search(std::string_view query,
+    const SearchOptions& options, const std::function<bool()>& cancelled) {
+  auto lock = std::lock_guard(m_db_mutex);
+
+  // interrupt running statement, when search was cancelled
+  auto results = SearchResults{ };
+  m_db->set_progress_handler(search_progress_instructions, cancelled);
+  try {
+    const auto& search = rank_matches(query, options.filter, options.weights);
+    results.matches = get_search_results(query, options, search);
+    results.total_count = static_cast<int64_t>(search.matches.size());
+    results.total_count_exact = search.complete;
+    for (const auto& facet : options.facets)
+      results.facets.push_back(
+        get_search_facet(query, options.filter, facet, options.max_facet_values));
+    m_db->set_progress_handler(0, nullptr);
+  }
+  catch (...) {
+    m_db->set_progress_handler(0, nullptr);
+    if (cancelled && cancelled())
+      return std::nullopt;
+    throw;
+  }
+  return results;
+}
+
+const CachedSearch& Database::rank_matches(std::string_view query,
+    const SearchFilter& filter, const SearchWeights& weights) {
+  const auto rank_function = get_rank_function(weights);
+  const auto options = get_filter_key(filter) + "|" + rank_function;
+  if (auto cached = m_search_cache.find(options, query))
+    return *cached;
+
+  // a refinement can only match rows the previous query matched
+  const auto refined = m_search_cache.find_refined(options, query);
+  const auto candidates = (refined ? refined->rowids : std::optional<RowIds>());
+
+  auto search = CachedSearch{ options, std::string(query), { }, true, { } };
+  if (candidates && candidates->empty()) {
+    search.rowids.emplace();
+    return m_search_cache.insert(std::move(search));
+  }
+
+  auto restriction = get_filter_condition(filter);
+  if (candidates && candidates->size() <= max_search_candidates) {
+    restriction += " AND pages.rowid IN (";
+    for (const auto rowid : *candidates)
+      restriction += std::to_string(rowid) + ",";
+    restriction.back() = ')';
+  }
+
+  // all columns are matched, the rank function weights them
+  const auto format = R"(
+    SELECT pages.rowid, c.url
+    FROM pages
+    JOIN page_contents c ON c.id = pages.rowid
+    WHERE pages MATCH ? AND pages.rank MATCH ? %s
+    ORDER BY pages.rank
+    LIMIT %zu
+  )";
+  auto buffer = std::vector<char>(256 + restriction.size());
+  std::snprintf(buffer.data(), buffer.size(), format,
+    restriction.c_str(),
+    max_ranked_matches + 1);
+
+  auto select = m_db->prepare(buffer.data());
+  select.bind(0, query);
+  select.bind(1, rank_function);
+  bind_filter(select, 2, filter);
+  auto result = select.query();
+  auto rowids = RowIds();
+  auto added = std::unordered_set<std::string>();
+  while (result.step()) {
+    if (rowids.size() == max_ranked_matches) {
+      search.complete = false;
+      break;
     }
+    const auto rowid = result.to_int64(0);
+    rowids.push_back(rowid);
+    if (added.emplace(result.to_text(1)).second)
+      search.matches.push_back(rowid);
   }
+  if (search.complete)
+    search.rowids = std::move(rowids);
+  return m_search_cache.insert(std::move(search));
+}
+
+std::vector<SearchResult> Database::get_search_results(std::string_view query,
+    const SearchOptions& options, const CachedSearch& search) {
+  const auto offset = std::clamp(static_cast<size_t>(std::max(options.offset, 0)),
+    size_t{ }, search.matches.size());
+  const auto count = std::min(static_cast<size_t>(std::max(options.max_count, 0)),
+    search.matches.size() - offset);
+  const auto matches = nonstd::span<const int64_t>(
+    search.matches.data() + offset, count);
+  if (count == 0)
+    return { };
+
+  // generate snippets of requested page only
+  auto rowids = std::string();
+  for (const auto rowid : matches)
+    rowids += std::to_string(rowid) + ",";
+  rowids.pop_back();
+
+  const auto format = R"(
+    SELECT pages.rowid, c.uid, c.url, c.title,
+      snippet(pages, -1, %s, %s, '', %i)
+    FROM pages
+    JOIN page_contents c ON c.id = pages.rowid
+    WHERE pages MATCH ? AND pages.rowid IN (%s)
+  )";
+  auto buffer = std::vector<char>(256 + rowids.size());
+  std::snprintf(buffer.data(), buffer.size(), format,
+    options.highlight ? "'<b>'" : "''",
+    options.highlight ? "'</b>'" : "''",
+    options.snippet_size,
+    rowids.c_str());
+
+  auto select = m_db->prepare(buffer.data());
+  select.bind(0, query);
+  auto result = select.query();
+  auto results = std::vector<SearchResult>(count);
+  while (result.step()) {
+    const auto it = std::find(matches.begin(), matches.end(), result.to_int64(0));
+    if (it != matches.end())
+      results[static_cast<size_t>(std::distance(matches.begin(), it))] = {
+        result.to_int64(1),
+        std::string(result.to_text(2)),
+        std::string(result.to_text(3)),
+        std::string(result.to_text(4)),
+      };
+  }
+  return results;
+}
+
+SearchFacet Database::get_search_facet(std::string_view query,
+    const SearchFilter& filter, const std::string& name, int max_values) {
+  static const auto s_facet_columns = std::map<std::string_view, std::string_view>{
+    { "hostname", "c.hostname" },
+    { "archive", "c.uid" },
+    { "date", "strftime('%Y-%m', c.time, 'unixepoch')" },
+  };
+  const auto it = s_facet_columns.find(name);
+  if (it == s_facet_columns.end())
+    throw std::runtime_error("invalid facet " + name);
+
+  auto select = m_db->prepare(std::string() +
+    "SELECT " + std::string(it->second) + " AS value, COUNT(DISTINCT c.url) AS count "
+    "FROM page_contents c "
+    "WHERE c.id IN (SELECT rowid FROM pages WHERE pages MATCH ?) "
+    "AND value IS NOT NULL" + get_filter_condition(filter) + " "
+    "GROUP BY value ORDER BY count DESC, value LIMIT ?");
+  select.bind(0, query);
+  select.bind(bind_filter(select, 1, filter), max_values);
+
+  auto facet = SearchFacet{ name, { } };
+  auto result = select.query();
+  while (result.step())
+    facet.values.emplace_back(result.to_text(0), result.to_int64(1));
+  return facet;
 }
@@ -1,17 +1,73 @@
 #pragma once
 
+#include "SearchCache.h"
+#include "BlobStore.h"
 #include <memory>
 #include <mutex>
 #include <filesystem>
 #include <functional>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
 
 namespace sqlite { class Database; }
+struct IndexingPolicy;
+
+struct IndexMetrics {
+  int64_t page_count;
+  int64_t segment_count;
+  int64_t database_size;
+  int64_t skipped_page_count;
+  int64_t skipped_byte_count;
+  int64_t truncated_page_count;
+};
+
+struct SearchFilter {
+  // path of bookmark folder relative to library root
+  std::optional<std::string> folder;
+  std::optional<std::string> hostname;
+  // recording time in seconds since the epoch, the end is excluded
+  std::optional<int64_t> time_from;
+  std::optional<int64_t> time_to;
+};
+
+// bm25 weights of the indexed columns
+struct SearchWeights {
+  double title;
+  double heading;
+  double text;
+  double navigation;
+};
+
+struct SearchOptions {
+  SearchFilter filter;
+  SearchWeights weights;
+  bool highlight;
+  int snippet_size;
+  int offset;
+  int max_count;
+  std::vector<std::string> facets;
+  int max_facet_values;
+};
 
 struct SearchResult {
   int64_t uid;
-  std::string_view url;
-  std::string_view title;
-  std::string_view snippet;
+  std::string url;
+  std::string title;
+  std::string snippet;
+};
+
+struct SearchFacet {
+  std::string name;
+  std::vector<std::pair<std::string, int64_t>> values;
+};
+
+struct SearchResults {
+  std::vector<SearchResult> matches;
+  int64_t total_count;
+  bool total_count_exact;
+  std::vector<SearchFacet> facets;
 };
 
 class Database {
@@ -19,12 +75,60 @@ public:
   explicit Database(const std::filesystem::path& path);
   ~Database();
 
-  void update_index(const std::filesystem::path& path);
-  void execute_search(std::string_view query,
-    bool highlight, int snippet_size, int max_count,
-    const std::function<void(SearchResult)>& match_callback);
+  const std::filesystem::path& library_root() const { return m_library_root; }
+
+  // the functions modifying the index return the hashes of
+  // the blobs, which are no longer referenced by any archive
+  // records the blob references of an archive, which is not indexed yet
+  std::vector<std::string> record_blob_references(
+    const std::filesystem::path& path);
+  // an archive, which was only moved, is not reindexed unless requested
+  std::vector<std::string> update_index(const std::filesystem::path& path,
+    const IndexingPolicy& policy, bool reindex);
+  // updates the paths of the archives within moved files or directories,
+  // deleted archives are kept but excluded from searches
+  void move_archives(const std::vector<std::pair<std::filesystem::path,
+    std::filesystem::path>>& moved_paths, bool deleted);
+  std::vector<std::string> remove_archives(
+    const std::vector<std::filesystem::path>& paths);
+  int64_t get_blob_reference_count(std::string_view hash);
+  bool merge_index();
+  void optimize_index();
+  void vacuum_index();
+  IndexMetrics get_metrics();
+  std::optional<SearchResults> execute_search(std::string_view query,
+    const SearchOptions& options, const std::function<bool()>& cancelled);
 
 private:
+  bool schema_object_exists(std::string_view type, std::string_view name);
+  int get_schema_version();
+  void migrate_schema();
+  void migrate_to_compressed_contents();
+  void migrate_to_unindexed_metadata();
+  void migrate_to_idle_merging();
+  void migrate_to_page_metadata();
+  void migrate_to_archive_paths();
+  void migrate_to_heading_column();
+  void migrate_to_indexing_statistics();
+  void migrate_to_archive_file_state();
+  void migrate_to_blob_references();
+  void migrate_to_indexing_version();
+  std::string get_relative_path(const std::filesystem::path& path) const;
+  bool try_rekey_archive(int64_t uid, const std::string& path,
+    int64_t file_size, int64_t file_time, int64_t indexing_version);
+  std::vector<std::string> replace_blob_references(int64_t uid,
+    const std::vector<BlobReference>& references);
+  std::vector<std::string> get_unreferenced_blobs(
+    const std::set<std::string>& hashes);
+  const CachedSearch& rank_matches(std::string_view query,
+    const SearchFilter& filter, const SearchWeights& weights);
+  std::vector<SearchResult> get_search_results(std::string_view query,
+    const SearchOptions& options, const CachedSearch& search);
+  SearchFacet get_search_facet(std::string_view query,
+    const SearchFilter& filter, const std::string& name, int max_values);
+
+  const std::filesystem::path m_library_root;
   std::mutex m_db_mutex;
   std::unique_ptr<sqlite::Database> m_db;
+  SearchCache m_search_cache;
 };
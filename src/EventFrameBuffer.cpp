@@ -0,0 +1,77 @@
+
+#include "EventFrameBuffer.h"
+#include <utility>
+
+namespace {
+  const auto length_size = size_t{ 4 };
+  const auto header_size = size_t{ 1 + 2 + 8 };
+  const auto define_type = uint8_t{ 0 };
+
+  uint64_t read_le(std::string_view data, size_t size) {
+    auto value = uint64_t{ };
+    for (auto i = size; i > 0; --i)
+      value = (value << 8) | static_cast<uint8_t>(data[i - 1]);
+    return value;
+  }
+} // namespace
+
+EventFrameBuffer::EventFrameBuffer(size_t capacity)
+  : m_capacity(capacity) {
+}
+
+void EventFrameBuffer::append(const char* data, size_t size) {
+  m_incomplete_frame.append(data, size);
+
+  auto frames = std::string_view(m_incomplete_frame);
+  while (frames.size() >= length_size) {
+    const auto length = static_cast<size_t>(read_le(frames, length_size));
+    if (frames.size() < length_size + length)
+      break;
+    decode_frame(frames.substr(length_size, length));
+    frames.remove_prefix(length_size + length);
+  }
+  m_incomplete_frame.erase(0, m_incomplete_frame.size() - frames.size());
+
+  // a corrupted length must not let the buffer grow unbounded
+  if (m_incomplete_frame.size() > m_capacity)
+    m_incomplete_frame.clear();
+
+  while (m_size > m_capacity && !m_events.empty()) {
+    m_size -= length_size + header_size + m_events.front().url.size();
+    m_events.pop_front();
+    ++m_dropped;
+  }
+}
+
+void EventFrameBuffer::decode_frame(std::string_view frame) {
+  if (frame.size() < header_size)
+    return;
+  const auto type = static_cast<uint8_t>(frame[0]);
+  const auto status = static_cast<uint16_t>(read_le(frame.substr(1), 2));
+  const auto size = read_le(frame.substr(3), 8);
+  const auto url = frame.substr(header_size);
+
+  // types can not be redefined, the buffered events reference their names
+  if (type == define_type) {
+    if (status != define_type && status <= UINT8_MAX)
+      m_type_names.emplace(static_cast<uint8_t>(status), std::string(url));
+    return;
+  }
+
+  const auto it = m_type_names.find(type);
+  if (it == m_type_names.end()) {
+    ++m_dropped;
+    return;
+  }
+  m_events.push_back({ it->second, status, size, std::string(url) });
+  m_size += length_size + frame.size();
+}
+
+size_t EventFrameBuffer::consume(
+    const std::function<void(const Event&)>& callback) {
+  for (const auto& event : m_events)
+    callback(event);
+  m_events.clear();
+  m_size = 0;
+  return std::exchange(m_dropped, 0);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+// decodes the binary event frames a webrecorder writes to its event channel
+// and buffers up to a capacity, then the oldest events are dropped.
+// All integers are little endian, each frame consists of:
+//   uint32 length of the rest of the frame
+//   uint8  type
+//   uint16 status
+//   uint64 size
+//   url (remaining bytes)
+// Frames of type 0 define the name of the type passed in status by the url.
+class EventFrameBuffer {
+public:
+  struct Event {
+    std::string_view type;
+    uint16_t status;
+    uint64_t size;
+    std::string url;
+  };
+
+  explicit EventFrameBuffer(size_t capacity);
+
+  void append(const char* data, size_t size);
+  bool empty() const { return m_events.empty(); }
+
+  // passes and removes all decoded events,
+  // returns the number of events dropped since the last call
+  size_t consume(const std::function<void(const Event&)>& callback);
+
+private:
+  void decode_frame(std::string_view frame);
+
+  const size_t m_capacity;
+  std::map<uint8_t, std::string> m_type_names;
+  std::deque<Event> m_events;
+  std::string m_incomplete_frame;
+  // size of the buffered frames
+  size_t m_size{ };
+  size_t m_dropped{ };
+};
@@ -0,0 +1,169 @@
+
+#include "FileOperations.h"
+#include <vector>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# if !defined(NOMINMAX)
+#   define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace {
+  void check_cancelled(const FileOperationProgress& progress) {
+    if (progress.cancelled)
+      throw FileOperationCancelled();
+  }
+
+  // a symlink to a directory is handled like a file,
+  // the link's target is not owned by the library
+  bool is_real_directory(const std::filesystem::path& path) {
+    return std::filesystem::is_directory(std::filesystem::symlink_status(path));
+  }
+
+  bool is_real_directory(const std::filesystem::directory_entry& entry) {
+    return std::filesystem::is_directory(entry.symlink_status());
+  }
+
+  uint64_t count_files(const std::filesystem::path& path) {
+    if (!is_real_directory(path))
+      return 1;
+    auto count = uint64_t{ };
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+      if (!is_real_directory(entry))
+        ++count;
+    return count;
+  }
+
+  // flushes the file's content to the storage device
+  void sync_file(const std::filesystem::path& path) {
+#if defined(_WIN32)
+    const auto handle = ::CreateFileW(path.c_str(), GENERIC_WRITE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+      throw std::runtime_error("opening file failed");
+    const auto succeeded = ::FlushFileBuffers(handle);
+    ::CloseHandle(handle);
+#else
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::runtime_error("opening file failed");
+    const auto succeeded = (::fsync(fd) == 0);
+    ::close(fd);
+#endif
+    if (!succeeded)
+      throw std::runtime_error("syncing file failed");
+  }
+
+  void copy_and_remove(const std::filesystem::path& from,
+      const std::filesystem::path& to, FileOperationProgress& progress) {
+    check_cancelled(progress);
+
+    if (is_real_directory(from)) {
+      create_directories_handle_symlinks(to);
+      for (const auto& file : std::filesystem::directory_iterator(from))
+        copy_and_remove(file.path(), to / file.path().filename(), progress);
+      std::filesystem::remove(from);
+      return;
+    }
+
+    if (std::filesystem::is_symlink(from)) {
+      std::filesystem::copy_symlink(from, to);
+      std::filesystem::remove(from);
+      ++progress.processed_files;
+      progress.moved_paths.emplace_back(from, to);
+      return;
+    }
+
+    // do not leave an incomplete copy behind
+    try {
+      std::filesystem::copy_file(from, to);
+      // keep modification time, which identifies unmodified archives
+      std::filesystem::last_write_time(to, std::filesystem::last_write_time(from));
+      sync_file(to);
+    }
+    catch (...) {
+      auto error = std::error_code{ };
+      std::filesystem::remove(to, error);
+      throw;
+    }
+    progress.copied_bytes += std::filesystem::file_size(to);
+    std::filesystem::remove(from);
+    ++progress.processed_files;
+    progress.moved_paths.emplace_back(from, to);
+  }
+
+  void move_file(const std::filesystem::path& from,
+      const std::filesystem::path& to, FileOperationProgress& progress) {
+    if (from == to)
+      return;
+    check_cancelled(progress);
+
+    if (is_real_directory(from) && std::filesystem::is_directory(to)) {
+      // merge directories
+      for (const auto& file : std::filesystem::directory_iterator(from))
+        move_file(file.path(), to / relative(file.path(), from), progress);
+      return;
+    }
+
+    if (std::filesystem::exists(to))
+      throw std::runtime_error("file exists");
+
+    create_directories_handle_symlinks(to.parent_path());
+    const auto files = count_files(from);
+    auto error = std::error_code{ };
+    std::filesystem::rename(from, to, error);
+    if (error == std::errc::cross_device_link)
+      return copy_and_remove(from, to, progress);
+    if (error)
+      throw std::filesystem::filesystem_error("moving file failed", from, to, error);
+    progress.processed_files += files;
+    progress.moved_paths.emplace_back(from, to);
+  }
+} // namespace
+
+void create_directories_handle_symlinks(const std::filesystem::path& path) {
+  if (!std::filesystem::is_symlink(path))
+    std::filesystem::create_directories(path);
+}
+
+void move_files(const std::filesystem::path& from,
+    const std::filesystem::path& to, FileOperationProgress& progress) {
+  progress.total_files = count_files(from);
+  progress.moved_paths.clear();
+  move_file(from, to, progress);
+  progress.moved_paths = { { from, to } };
+}
+
+void remove_files(const std::filesystem::path& path,
+    FileOperationProgress& progress) {
+  progress.total_files = count_files(path);
+  progress.removed_paths.clear();
+  if (!is_real_directory(path)) {
+    std::filesystem::remove(path);
+    ++progress.processed_files;
+    progress.removed_paths = { path };
+    return;
+  }
+
+  // deepest entries first, so the removal can stop between any two files
+  auto entries = std::vector<std::filesystem::directory_entry>(
+    std::filesystem::recursive_directory_iterator(path),
+    std::filesystem::recursive_directory_iterator());
+  for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+    check_cancelled(progress);
+    const auto is_directory = is_real_directory(*it);
+    std::filesystem::remove(it->path());
+    if (!is_directory) {
+      ++progress.processed_files;
+      progress.removed_paths.push_back(it->path());
+    }
+  }
+  std::filesystem::remove(path);
+  progress.removed_paths = { path };
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// progress of a file operation executed by another thread,
+// which can be cancelled between two files
+struct FileOperationProgress {
+  std::atomic<uint64_t> total_files{ };
+  std::atomic<uint64_t> processed_files{ };
+  std::atomic<uint64_t> copied_bytes{ };
+  std::atomic<bool> cancelled{ };
+
+  // the completed part of a cancelled or failed operation,
+  // only accessed by the executing thread
+  std::vector<std::pair<std::filesystem::path,
+    std::filesystem::path>> moved_paths;
+  std::vector<std::filesystem::path> removed_paths;
+};
+
+class FileOperationCancelled : public std::runtime_error {
+public:
+  FileOperationCancelled() : std::runtime_error("cancelled") { }
+};
+
+void create_directories_handle_symlinks(const std::filesystem::path& path);
+
+// moves a file or directory, directories are merged with existing ones.
+// Files which can not be renamed, because the target is on another
+// filesystem, are copied, synced and removed one after another
+void move_files(const std::filesystem::path& from,
+  const std::filesystem::path& to, FileOperationProgress& progress);
+
+// removes a file or directory with all its contents
+void remove_files(const std::filesystem::path& path,
+  FileOperationProgress& progress);
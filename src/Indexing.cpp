@@ -1,14 +1,100 @@
 ﻿
 #include "Indexing.h"
+#include "PdfText.h"
+#include "BlobStore.h"
 #include "gumbo.h"
 #include "libs/webrecorder/src/HeaderStore.h"
+#include <algorithm>
 #include <cstring>
+#include <map>
 #include <sstream>
+#include <unordered_set>
 
 namespace {
-  bool is_html_or_plaintext_mime_type(std::string_view mime_type) {
-    return iequals_any(mime_type,
-      "text/html", "text/plain", "text", "html", "plain");
+  using Deadline = std::chrono::steady_clock::time_point;
+  using TextCallback = std::function<void(std::string_view, HtmlSection)>;
+
+  // increment when the extracted text of a document changes
+  const auto text_extractor_version = uint64_t{ 1 };
+
+  // returns the last path segment of an url, which is used as title
+  // of documents without one
+  std::string_view get_url_filename(std::string_view url) {
+    url = url.substr(0, url.find_first_of("?#"));
+    while (!url.empty() && url.back() == '/')
+      url.remove_suffix(1);
+    return url.substr(url.rfind('/') + 1);
+  }
+
+  void extract_html_text(const ArchiveDocument& document,
+      Deadline, const TextCallback& text_callback) {
+    for_each_html_text(document.data, text_callback);
+  }
+
+  void extract_plain_text(const ArchiveDocument& document,
+      Deadline, const TextCallback& text_callback) {
+    text_callback(get_url_filename(document.url), HtmlSection::title);
+    text_callback(document.data, HtmlSection::content);
+  }
+
+  void extract_pdf_text(const ArchiveDocument& document,
+      Deadline deadline, const TextCallback& text_callback) {
+    auto has_title = false;
+    for_each_pdf_text(document.data, deadline,
+      [&](std::string_view text) {
+        text_callback(text, HtmlSection::content);
+      },
+      [&](std::string_view title) {
+        text_callback(title, HtmlSection::title);
+        has_title = true;
+      });
+    if (!has_title)
+      text_callback(get_url_filename(document.url), HtmlSection::title);
+  }
+
+  struct TextExtractor {
+    std::string_view mime_type;
+    bool convert_charset;
+    void(*extract)(const ArchiveDocument&, Deadline, const TextCallback&);
+  };
+
+  // new document types are supported by adding an extractor
+  const TextExtractor text_extractors[] = {
+    { "text/html", true, &extract_html_text },
+    { "html", true, &extract_html_text },
+    { "text/plain", true, &extract_plain_text },
+    { "text", true, &extract_plain_text },
+    { "plain", true, &extract_plain_text },
+    { "application/pdf", false, &extract_pdf_text },
+  };
+
+  const TextExtractor* find_text_extractor(std::string_view mime_type) {
+    for (const auto& extractor : text_extractors)
+      if (iequals(mime_type, extractor.mime_type))
+        return &extractor;
+    return nullptr;
+  }
+
+  // resolves a link relative to the url of the page containing it,
+  // dot segments are not normalized
+  std::string resolve_link(std::string_view base, std::string_view link) {
+    link = link.substr(0, link.find('#'));
+    const auto scheme_end = base.find("://");
+    if (scheme_end == std::string_view::npos)
+      return { };
+    if (const auto colon = link.find(':');
+        colon != std::string_view::npos && colon < link.find_first_of("/?"))
+      return std::string(link);
+    if (link.substr(0, 2) == "//")
+      return std::string(base.substr(0, scheme_end + 1)).append(link);
+    const auto origin = base.substr(0, base.find('/', scheme_end + 3));
+    if (link.substr(0, 1) == "/")
+      return std::string(origin).append(link);
+    const auto path = base.substr(0, base.find_first_of("?#"));
+    const auto directory_end = path.rfind('/');
+    if (directory_end < origin.size())
+      return std::string(origin).append("/").append(link);
+    return std::string(path.substr(0, directory_end + 1)).append(link);
   }
 } // namespace
 
@@ -20,6 +106,21 @@ int64_t get_archive_uid(const ArchiveReader& reader) {
   return uid;
 }
 
+uint64_t get_indexing_version(const IndexingPolicy& policy) {
+  // FNV-1a, which is stable between runs
+  auto hash = uint64_t{ 14695981039346656037u };
+  for (auto value : { text_extractor_version,
+                      uint64_t{ policy.max_pages },
+                      policy.max_bytes,
+                      uint64_t{ policy.max_text_length },
+                      policy.max_document_size,
+                      static_cast<uint64_t>(policy.max_extraction_time.count()) }) {
+    hash ^= value;
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
 void for_each_archive_file(const ArchiveReader& reader,
     std::function<void(ArchiveFile)> file_callback) {
 
@@ -38,12 +139,29 @@ void for_each_archive_file(const ArchiveReader& reader,
   }
 }
 
-void for_each_archive_html(const ArchiveReader& reader,
-    std::function<void(ArchiveHtml)> file_callback) {
+IndexingStatistics for_each_archive_document(const ArchiveReader& reader,
+    const IndexingPolicy& policy, const std::filesystem::path& blob_store,
+    std::function<void(ArchiveDocument)> document_callback) {
 
   const auto url = std::string(as_string_view(reader.read("url")));
   const auto base_hostname = get_hostname(url);
 
+  struct Candidate {
+    const std::string* url;
+    std::string filename;
+    std::string_view mime_type;
+    std::string charset;
+    uint64_t size;
+    const TextExtractor* extractor;
+    bool linked;
+    std::filesystem::path blob_path;
+  };
+  auto candidates = std::vector<Candidate>();
+
+  auto blob_paths = std::map<std::string, std::filesystem::path, std::less<>>();
+  for (const auto& reference : get_blob_references(reader))
+    blob_paths[reference.url] = get_blob_path(blob_store, reference.hash);
+
   auto header = reader.read("headers");
   auto header_store = HeaderStore();
   header_store.deserialize(as_string_view(header));
@@ -59,16 +177,107 @@ void for_each_archive_html(const ArchiveReader& reader,
         continue;
     if (auto it = header.find("Content-Type"); it != header.end()) {
       const auto [mime_type, charset] = split_content_type(it->second);
-      if (is_html_or_plaintext_mime_type(mime_type)) {
-        auto data = reader.read(to_local_filename(entry.first));
-        if (!data.empty())
-          file_callback({
-            entry.first,
-            convert_charset(data, charset, "UTF-8")
-          });
+      if (const auto extractor = find_text_extractor(mime_type)) {
+        auto filename = to_local_filename(entry.first);
+        const auto info = reader.get_file_info(filename);
+        if (info.has_value() && info->uncompressed_size > 0) {
+          candidates.push_back({ &entry.first, std::move(filename), mime_type,
+            std::string(charset), info->uncompressed_size, extractor, false, { } });
+        }
+        else if (auto it = blob_paths.find(entry.first);
+                 it != blob_paths.end() && !it->second.empty()) {
+          auto error = std::error_code{ };
+          const auto size = std::filesystem::file_size(it->second, error);
+          if (!error && size > 0)
+            candidates.push_back({ &entry.first, std::move(filename), mime_type,
+              std::string(charset), size, extractor, false, it->second });
+        }
       }
     }
   }
+
+  auto statistics = IndexingStatistics{ };
+  const auto index_candidate = [&](const Candidate& candidate,
+      const std::function<void(std::string_view)>& html_callback) {
+    if (statistics.indexed_pages >= policy.max_pages ||
+        statistics.indexed_bytes + candidate.size > policy.max_bytes ||
+        candidate.size > policy.max_document_size) {
+      ++statistics.skipped_pages;
+      statistics.skipped_bytes += candidate.size;
+      return;
+    }
+    auto data = (candidate.blob_path.empty() ?
+      reader.read(candidate.filename) : read_blob(candidate.blob_path));
+    if (data.empty())
+      return;
+    ++statistics.indexed_pages;
+    statistics.indexed_bytes += candidate.size;
+    // blobs are shared, use the time of the recording
+    const auto info = reader.get_file_info(
+      candidate.blob_path.empty() ? candidate.filename : "url");
+    const auto document = (candidate.extractor->convert_charset ?
+      convert_charset(data, candidate.charset, "UTF-8") : as_string_view(data));
+    document_callback({
+      *candidate.url,
+      std::string(candidate.mime_type),
+      document,
+      (info.has_value() ? info->modification_time : time_t{ }),
+    });
+    if (html_callback && candidate.extractor->extract == &extract_html_text)
+      html_callback(document);
+  };
+
+  // index main page first, then pages it links to, then the rest
+  const auto main_page = std::find_if(candidates.begin(), candidates.end(),
+    [&](const Candidate& candidate) { return *candidate.url == url; });
+  if (main_page != candidates.end()) {
+    index_candidate(*main_page, [&](std::string_view html) {
+      auto links = std::unordered_set<std::string>();
+      for_each_html_link(html, [&](std::string_view link) {
+        links.insert(resolve_link(url, link));
+      });
+      for (auto& candidate : candidates)
+        candidate.linked = (links.count(*candidate.url) != 0);
+    });
+    candidates.erase(main_page);
+  }
+  std::stable_partition(candidates.begin(), candidates.end(),
+    [](const Candidate& candidate) { return candidate.linked; });
+
+  for (const auto& candidate : candidates)
+    index_candidate(candidate, nullptr);
+  return statistics;
+}
+
+void extract_document_text(const ArchiveDocument& document,
+    std::chrono::milliseconds max_time,
+    std::function<void(std::string_view, HtmlSection)> text_callback) {
+  if (const auto extractor = find_text_extractor(document.mime_type))
+    extractor->extract(document,
+      std::chrono::steady_clock::now() + max_time, text_callback);
+}
+
+void for_each_html_link(std::string_view html,
+    std::function<void(std::string_view)> link_callback) {
+
+  const auto output = gumbo_parse_with_options(
+    &kGumboDefaultOptions, html.data(), html.size());
+
+  const auto rec = [&](const GumboElement& element, const auto& rec) -> void {
+    if (element.tag == GUMBO_TAG_A)
+      if (const auto href = gumbo_get_attribute(&element.attributes, "href"))
+        link_callback(href->value);
+
+    for (auto i = 0u; i < element.children.length; ++i) {
+      const auto& child = *static_cast<const GumboNode*>(element.children.data[i]);
+      if (child.type == GUMBO_NODE_ELEMENT)
+        rec(child.v.element, rec);
+    }
+  };
+  if (output->root->type == GUMBO_NODE_ELEMENT)
+    rec(output->root->v.element, rec);
+
+  gumbo_destroy_output(&kGumboDefaultOptions, output);
 }
 
 void for_each_html_text(std::string_view html,
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "libs/webrecorder/src/Archive.h"
+#include <chrono>
 #include <filesystem>
 #include <functional>
 
@@ -12,9 +13,26 @@ struct ArchiveFile {
   time_t modification_time;
 };
 
-struct ArchiveHtml {
+struct ArchiveDocument {
   std::string url;
-  std::string_view html;
+  std::string mime_type;
+  std::string_view data;
+  time_t modification_time;
+};
+
+struct IndexingPolicy {
+  size_t max_pages;
+  uint64_t max_bytes;
+  size_t max_text_length;
+  uint64_t max_document_size;
+  std::chrono::milliseconds max_extraction_time;
+};
+
+struct IndexingStatistics {
+  size_t indexed_pages;
+  uint64_t indexed_bytes;
+  size_t skipped_pages;
+  uint64_t skipped_bytes;
 };
 
 enum class HtmlSection {
@@ -25,9 +43,21 @@ enum class HtmlSection {
 };
 
 int64_t get_archive_uid(const ArchiveReader& reader);
+// changes with the policy or the text extraction, so archives indexed
+// differently can be told apart
+uint64_t get_indexing_version(const IndexingPolicy& policy);
 void for_each_archive_file(const ArchiveReader& reader,
   std::function<void(ArchiveFile)> file_callback);
-void for_each_archive_html(const ArchiveReader& reader,
-  std::function<void(ArchiveHtml)> file_callback);
+// documents stored in the blob store are read from there
+IndexingStatistics for_each_archive_document(const ArchiveReader& reader,
+  const IndexingPolicy& policy, const std::filesystem::path& blob_store,
+  std::function<void(ArchiveDocument)> document_callback);
+void for_each_html_link(std::string_view html,
+  std::function<void(std::string_view)> link_callback);
 void for_each_html_text(std::string_view html,
   std::function<void(std::string_view, HtmlSection)> text_callback);
+
+// the strings passed to the callback are only valid during the call
+void extract_document_text(const ArchiveDocument& document,
+  std::chrono::milliseconds max_time,
+  std::function<void(std::string_view, HtmlSection)> text_callback);
@@ -49,12 +49,30 @@ std::optional<int> try_get_int(const Value& message, const char* name) {
   return it->value.GetInt();
 }
 
+std::optional<int64_t> try_get_int64(const Value& message, const char* name) {
+  if (!message.IsObject())
+    return std::nullopt;
+  const auto it = message.FindMember(name);
+  if (it == message.MemberEnd() || !it->value.IsInt64())
+    return std::nullopt;
+  return it->value.GetInt64();
+}
+
 int get_int(const Value& message, const char* name) {
   if (auto optional = try_get_int(message, name))
     return *optional;
   throw Exception("int '" + std::string(name) + "' expected");
 }
 
+std::optional<double> try_get_double(const Value& message, const char* name) {
+  if (!message.IsObject())
+    return std::nullopt;
+  const auto it = message.FindMember(name);
+  if (it == message.MemberEnd() || !it->value.IsNumber())
+    return std::nullopt;
+  return it->value.GetDouble();
+}
+
 std::optional<std::string_view> try_get_string(const Value& message, const char* name) {
   if (!message.IsObject())
     return std::nullopt;
@@ -83,7 +101,7 @@ std::vector<int> get_int_list(const Value& message, const char* name) {
   throw Exception("array '" + std::string(name) + "' expected");
 }
 
-std::vector<std::string_view> get_string_list(const Value& message, const char* name) {
+std::optional<std::vector<std::string_view>> try_get_string_list(const Value& message, const char* name) {
   if (const auto array = try_get_array(message, name)) {
     auto result = std::vector<std::string_view>();
     for (auto it = array->Begin(), end = array->End(); it != end; ++it) {
@@ -93,6 +111,12 @@ std::vector<std::string_view> get_string_list(const Value& message, const char*
     }
     return result;
   }
+  return std::nullopt;
+}
+
+std::vector<std::string_view> get_string_list(const Value& message, const char* name) {
+  if (auto optional = try_get_string_list(message, name))
+    return std::move(*optional);
   throw Exception("array '" + std::string(name) + "' expected");
 }
 
@@ -25,9 +25,12 @@ bool get_bool(const Value& message, const char* name);
 std::optional<bool> try_get_bool(const Value& message, const char* name);
 int get_int(const Value& message, const char* name);
 std::optional<int> try_get_int(const Value& message, const char* name);
+std::optional<int64_t> try_get_int64(const Value& message, const char* name);
+std::optional<double> try_get_double(const Value& message, const char* name);
 std::string_view get_string(const Value& value, const char* name);
 std::optional<std::string_view> try_get_string(const Value& value, const char* name);
 std::vector<int> get_int_list(const Value& message, const char* name);
+std::optional<std::vector<std::string_view>> try_get_string_list(const Value& message, const char* name);
 std::vector<std::string_view> get_string_list(const Value& message, const char* name);
 std::string build_string(const std::function<void(Writer&)>& write);
 
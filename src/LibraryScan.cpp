@@ -0,0 +1,175 @@
+
+#include "LibraryScan.h"
+#include "common.h"
+#include "libs/webrecorder/src/Archive.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace {
+  bool less_filename(const LibraryFile& a, const LibraryFile& b) {
+    return a.filename < b.filename;
+  }
+
+  struct ScanTask {
+    std::filesystem::path path;
+    bool is_directory;
+  };
+
+  class LibraryScan {
+  public:
+    LibraryScan(const std::filesystem::path& library_root,
+                const std::vector<std::filesystem::path>& paths)
+      : m_library_root(library_root) {
+      auto error = std::error_code{ };
+      for (const auto& path : paths)
+        m_tasks.push_back({ path, std::filesystem::is_directory(path, error) });
+      m_pending = m_tasks.size();
+    }
+
+    void thread_func() noexcept {
+      for (;;) {
+        auto lock = std::unique_lock(m_mutex);
+        m_signal.wait(lock, [&]() { return m_pending == 0 || !m_tasks.empty(); });
+        if (m_tasks.empty())
+          break;
+        auto task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        lock.unlock();
+
+        try {
+          if (task.is_directory)
+            list_directory(task.path);
+          else
+            read_archive(task.path);
+        }
+        catch (...) {
+        }
+
+        lock.lock();
+        if (--m_pending == 0) {
+          lock.unlock();
+          m_signal.notify_all();
+        }
+      }
+    }
+
+    std::vector<LibraryFile> take_files() {
+      std::sort(m_files.begin(), m_files.end(), less_filename);
+      return std::move(m_files);
+    }
+
+  private:
+    void list_directory(const std::filesystem::path& directory) {
+      auto error = std::error_code{ };
+      auto tasks = std::vector<ScanTask>();
+      for (const auto& entry : std::filesystem::directory_iterator(directory,
+             std::filesystem::directory_options::skip_permission_denied, error)) {
+        if (is_hidden(entry.path()))
+          continue;
+        if (entry.is_directory(error)) {
+          if (entry.is_symlink(error) && !visit_symlink(entry.path()))
+            continue;
+          tasks.push_back({ entry.path(), true });
+        }
+        else if (entry.is_regular_file(error)) {
+          tasks.push_back({ entry.path(), false });
+        }
+      }
+      if (tasks.empty())
+        return;
+
+      auto lock = std::unique_lock(m_mutex);
+      m_pending += tasks.size();
+      m_tasks.insert(m_tasks.end(),
+        std::make_move_iterator(tasks.begin()),
+        std::make_move_iterator(tasks.end()));
+      lock.unlock();
+      m_signal.notify_all();
+    }
+
+    // prevent following directory symlinks in cycles
+    bool visit_symlink(const std::filesystem::path& path) {
+      auto error = std::error_code{ };
+      auto target = std::filesystem::canonical(path, error);
+      if (error)
+        return false;
+      auto lock = std::unique_lock(m_mutex);
+      return m_visited_symlinks.insert(std::move(target)).second;
+    }
+
+    void read_archive(const std::filesystem::path& path) {
+      auto reader = ArchiveReader();
+      if (!reader.open_root(path))
+        return;
+      auto url = reader.read("url");
+      if (url.empty())
+        return;
+      auto file = LibraryFile{
+        path.lexically_relative(m_library_root),
+        std::string(as_string_view(url))
+      };
+      auto lock = std::unique_lock(m_mutex);
+      m_files.push_back(std::move(file));
+    }
+
+    const std::filesystem::path& m_library_root;
+    std::mutex m_mutex;
+    std::condition_variable m_signal;
+    std::deque<ScanTask> m_tasks;
+    size_t m_pending{ };
+    std::set<std::filesystem::path> m_visited_symlinks;
+    std::vector<LibraryFile> m_files;
+  };
+} // namespace
+
+bool is_hidden(const std::filesystem::path& path) {
+  const auto filename = path.filename().native();
+  return (!filename.empty() && filename.front() == '.');
+}
+
+bool is_within(const std::filesystem::path& path,
+    const std::filesystem::path& directory) {
+  return (std::mismatch(directory.begin(), directory.end(),
+    path.begin(), path.end()).first == directory.end());
+}
+
+std::vector<LibraryFile> scan_library(
+    const std::filesystem::path& library_root, int thread_count) {
+  return scan_library(library_root, { library_root }, thread_count);
+}
+
+std::vector<LibraryFile> scan_library(
+    const std::filesystem::path& library_root,
+    const std::vector<std::filesystem::path>& paths, int thread_count) {
+  auto scan = LibraryScan(library_root, paths);
+  auto threads = std::vector<std::thread>();
+  for (auto i = 1; i < thread_count; ++i)
+    threads.emplace_back(&LibraryScan::thread_func, &scan);
+  scan.thread_func();
+  for (auto& thread : threads)
+    thread.join();
+  return scan.take_files();
+}
+
+void update_library_files(std::vector<LibraryFile>& files,
+    const std::vector<std::filesystem::path>& changed_paths,
+    std::vector<LibraryFile> rescanned_files) {
+  files.erase(std::remove_if(files.begin(), files.end(),
+    [&](const LibraryFile& file) {
+      return std::any_of(changed_paths.begin(), changed_paths.end(),
+        [&](const std::filesystem::path& path) {
+          return is_within(file.filename, path);
+        });
+    }), files.end());
+
+  const auto middle = static_cast<std::ptrdiff_t>(files.size());
+  files.insert(files.end(),
+    std::make_move_iterator(rescanned_files.begin()),
+    std::make_move_iterator(rescanned_files.end()));
+  std::inplace_merge(files.begin(), files.begin() + middle, files.end(),
+    less_filename);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct LibraryFile {
+  // path relative to the library root
+  std::filesystem::path filename;
+  std::string url;
+};
+
+// files and directories starting with a dot, like the trash and the index
+// database, are neither listed nor watched
+bool is_hidden(const std::filesystem::path& path);
+
+// whether the path is the directory or within it
+bool is_within(const std::filesystem::path& path,
+  const std::filesystem::path& directory);
+
+// recursively lists the archives in the library and reads their URLs.
+// Directories are traversed and archives opened by a pool of threads,
+// the result is ordered by filename.
+std::vector<LibraryFile> scan_library(
+  const std::filesystem::path& library_root, int thread_count);
+
+// scans only some files and directories within the library
+std::vector<LibraryFile> scan_library(
+  const std::filesystem::path& library_root,
+  const std::vector<std::filesystem::path>& paths, int thread_count);
+
+// replaces the files within the changed paths (relative to the library root)
+// by the files found when rescanning them
+void update_library_files(std::vector<LibraryFile>& files,
+  const std::vector<std::filesystem::path>& changed_paths,
+  std::vector<LibraryFile> rescanned_files);
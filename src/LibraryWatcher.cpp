@@ -0,0 +1,238 @@
+
+#include "LibraryWatcher.h"
+#include "LibraryScan.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+  const auto watch_mask = uint32_t{ IN_CREATE | IN_CLOSE_WRITE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR };
+  // report after no change happened for a while, but at least every few seconds
+  const auto quiet_delay = std::chrono::milliseconds(500);
+  const auto max_delay = std::chrono::seconds(5);
+
+  class Watches {
+  public:
+    explicit Watches(int fd) : m_fd(fd) { }
+
+    // follows directory symlinks like the library scan,
+    // returns false when not all directories could be watched
+    bool add_tree(const std::filesystem::path& directory) {
+      auto complete = true;
+      auto directories = std::vector<std::filesystem::path>{ directory };
+      while (!directories.empty()) {
+        const auto path = std::move(directories.back());
+        directories.pop_back();
+        if (!add(path, complete))
+          continue;
+
+        auto error = std::error_code{ };
+        for (auto it = std::filesystem::directory_iterator(path,
+               std::filesystem::directory_options::skip_permission_denied, error);
+             !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+          auto is_directory_error = std::error_code{ };
+          if (!is_hidden(it->path()) && it->is_directory(is_directory_error))
+            directories.push_back(it->path());
+        }
+        if (error)
+          complete = false;
+      }
+      return complete;
+    }
+
+    void remove_tree(const std::filesystem::path& directory) {
+      for (auto it = m_paths.begin(); it != m_paths.end(); )
+        if (is_within(it->second, directory)) {
+          inotify_rm_watch(m_fd, it->first);
+          it = m_paths.erase(it);
+        }
+        else {
+          ++it;
+        }
+    }
+
+    void forget(int wd) {
+      m_paths.erase(wd);
+    }
+
+    const std::filesystem::path* find(int wd) const {
+      const auto it = m_paths.find(wd);
+      return (it != m_paths.end() ? &it->second : nullptr);
+    }
+
+  private:
+    // returns whether the directory's content should be added
+    bool add(const std::filesystem::path& directory, bool& complete) {
+      const auto wd = inotify_add_watch(m_fd, directory.c_str(), watch_mask);
+      if (wd < 0) {
+        // fails when the limit of watches was reached,
+        // a directory which was removed meanwhile does not matter
+        if (errno != ENOENT && errno != ENOTDIR)
+          complete = false;
+        return false;
+      }
+      const auto [it, inserted] = m_paths.emplace(wd, directory);
+      if (inserted)
+        return true;
+      // changes of a directory reachable by two paths
+      // are only reported for one of them
+      if (it->second != directory)
+        complete = false;
+      return false;
+    }
+
+    const int m_fd;
+    std::map<int, std::filesystem::path> m_paths;
+  };
+
+  // drop paths within other changed directories
+  std::vector<std::filesystem::path> get_outermost(
+      const std::set<std::filesystem::path>& paths) {
+    auto result = std::vector<std::filesystem::path>();
+    for (const auto& path : paths)
+      if (result.empty() || !is_within(path, result.back()))
+        result.push_back(path);
+    return result;
+  }
+} // namespace
+
+LibraryWatcher::LibraryWatcher(std::filesystem::path root, Callback callback)
+  : m_root(std::move(root)),
+    m_callback(std::move(callback)) {
+  if (pipe2(m_stop_pipe, O_CLOEXEC) == 0)
+    m_thread = std::thread(&LibraryWatcher::thread_func, this);
+}
+
+LibraryWatcher::~LibraryWatcher() {
+  if (m_thread.joinable()) {
+    const auto stop = char{ };
+    [[maybe_unused]] const auto result = write(m_stop_pipe[1], &stop, 1);
+    m_thread.join();
+    close(m_stop_pipe[0]);
+    close(m_stop_pipe[1]);
+  }
+}
+
+void LibraryWatcher::thread_func() noexcept try {
+  const auto fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  auto watches = Watches(fd);
+  m_watching = watches.add_tree(m_root);
+
+  auto pending = std::set<std::filesystem::path>();
+  auto overflow = false;
+  auto first_change = Clock::time_point{ };
+  auto last_change = Clock::time_point{ };
+  alignas(inotify_event) char buffer[64 * 1024];
+  for (;;) {
+    auto timeout = -1;
+    if (!pending.empty() || overflow) {
+      const auto report_time = std::min(last_change + quiet_delay,
+                                        first_change + max_delay);
+      timeout = static_cast<int>(std::max(std::chrono::milliseconds::rep{ },
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+          report_time - Clock::now()).count() + 1));
+    }
+
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { m_stop_pipe[0], POLLIN, 0 } };
+    if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+      break;
+    if (fds[1].revents)
+      break;
+
+    for (;;) {
+      const auto size = read(fd, buffer, sizeof(buffer));
+      if (size <= 0)
+        break;
+      for (auto offset = ssize_t{ }; offset < size; ) {
+        const auto& event = *reinterpret_cast<const inotify_event*>(&buffer[offset]);
+        offset += static_cast<ssize_t>(sizeof(inotify_event) + event.len);
+
+        if (event.mask & IN_IGNORED) {
+          watches.forget(event.wd);
+          continue;
+        }
+        const auto directory = watches.find(event.wd);
+        if ((!directory || !event.len) && !(event.mask & IN_Q_OVERFLOW))
+          continue;
+
+        auto path = std::filesystem::path();
+        auto unwatched = false;
+        if (directory && event.len) {
+          path = *directory / event.name;
+          if (is_hidden(path))
+            continue;
+          // also a symlink to a directory
+          auto error = std::error_code{ };
+          if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (std::filesystem::is_directory(path, error) &&
+                !watches.add_tree(path))
+              unwatched = true;
+          }
+          else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            watches.remove_tree(path);
+          }
+        }
+
+        const auto now = Clock::now();
+        if (pending.empty() && !overflow)
+          first_change = now;
+        last_change = now;
+        // changes within unwatched directories would get lost,
+        // let the whole tree be rescanned
+        if (unwatched)
+          m_watching = false;
+        if (unwatched || (event.mask & IN_Q_OVERFLOW))
+          overflow = true;
+        else
+          pending.insert(std::move(path));
+      }
+    }
+
+    if (pending.empty() && !overflow)
+      continue;
+    const auto now = Clock::now();
+    if (now < last_change + quiet_delay &&
+        now < first_change + max_delay)
+      continue;
+
+    auto changes = Changes{ get_outermost(pending), overflow };
+    pending.clear();
+    overflow = false;
+    try {
+      m_callback(changes);
+    }
+    catch (...) {
+    }
+  }
+  close(fd);
+}
+catch (...) {
+}
+
+#else // !__linux__
+
+LibraryWatcher::LibraryWatcher(std::filesystem::path root, Callback callback)
+  : m_root(std::move(root)),
+    m_callback(std::move(callback)) {
+}
+
+LibraryWatcher::~LibraryWatcher() = default;
+
+void LibraryWatcher::thread_func() noexcept {
+}
+
+#endif // !__linux__
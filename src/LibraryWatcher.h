@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// watches a directory tree for changes (only implemented on Linux).
+// Bursts of changes are coalesced and reported from the watcher's thread,
+// once no further change happened for a short while. Hidden files and
+// directories (like the index database) are not watched.
+class LibraryWatcher {
+public:
+  struct Changes {
+    // created, modified, moved or removed files and directories
+    std::vector<std::filesystem::path> paths;
+    // some changes were lost and the whole tree should be rescanned
+    bool overflow;
+  };
+  using Callback = std::function<void(const Changes&)>;
+
+  LibraryWatcher(std::filesystem::path root, Callback callback);
+  LibraryWatcher(const LibraryWatcher&) = delete;
+  LibraryWatcher& operator=(const LibraryWatcher&) = delete;
+  ~LibraryWatcher();
+
+  // true while all directories are watched
+  bool watching() const { return m_watching; }
+
+private:
+  void thread_func() noexcept;
+
+  const std::filesystem::path m_root;
+  const Callback m_callback;
+  std::atomic<bool> m_watching{ };
+  int m_stop_pipe[2]{ -1, -1 };
+  std::thread m_thread;
+};
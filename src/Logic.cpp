@@ -2,9 +2,12 @@
 #include "Logic.h"
 #include "Database.h"
 #include "BackgroundWorker.h"
+#include "FileOperations.h"
+#include "BlobStore.h"
 #include "platform.h"
 #include "Indexing.h"
 #include "common.h"
+#include <algorithm>
 #include <random>
 #include <fstream>
 #include <sstream>
@@ -13,36 +16,35 @@
 namespace {
   const auto trash_directory_name = ".trash";
   const auto index_database_filename = ".hamster.sqlite";
+  const auto index_merge_idle_delay = std::chrono::seconds(1);
+  const auto default_max_recordings = size_t{ 8 };
+  const auto recorder_stats_interval = std::chrono::seconds(1);
+  const auto recorder_shutdown_timeout = std::chrono::seconds(2);
+  const auto trash_collection_idle_delay = std::chrono::seconds(10);
+  const auto blob_release_grace_period = std::chrono::hours(1);
+  // reading the archive headers is latency bound
+  const auto library_scan_threads = 8;
 
-  void create_directories_handle_symlinks(const std::filesystem::path& path) {
-    if (!std::filesystem::is_symlink(path))
-      std::filesystem::create_directories(path);
-  }
-
-  void do_move_file(const std::filesystem::path& from, const std::filesystem::path& to) {
-    if (from == to)
-      return;
-
-    if (std::filesystem::is_directory(from) && std::filesystem::is_directory(to)) {
-      // merge directories
-      for (const auto& file : std::filesystem::directory_iterator(from))
-        do_move_file(file.path(), to / relative(file.path(), from));
-    }
-    else {
-      if (std::filesystem::exists(to))
-        throw std::runtime_error("file exists");
-
-      create_directories_handle_symlinks(to.parent_path());
-      std::filesystem::rename(from, to);
-    }
-  }
+  const auto default_indexing_policy = IndexingPolicy{
+    200,                     // max_pages
+    uint64_t{ 64 } << 20,    // max_bytes
+    size_t{ 256 } << 10,     // max_text_length
+    uint64_t{ 32 } << 20,    // max_document_size
+    std::chrono::seconds(5), // max_extraction_time
+  };
 } // namespace
 
 Logic::Logic(const Settings& settings)
-  : m_settings(settings) {
+  : m_settings(settings),
+    m_max_recordings(default_max_recordings),
+    m_indexing_policy(default_indexing_policy) {
 }
 
 Logic::~Logic() {
+  stop_all_recordings();
+  cancel_file_jobs();
+  m_library_watcher.reset();
+  m_background_worker.reset();
   set_temporary_file(m_inject_script_file, "");
   set_temporary_file(m_block_hosts_file, "");
 }
@@ -65,39 +67,305 @@ void Logic::get_status(Response& response, const Request&) {
   response.EndObject();
 }
 
-void Logic::move_file(Response&, const Request& request) {
+void Logic::move_file(Response& response, const Request& request) {
   const auto from_path = to_full_path(json::get_string_list(request, "from"));
   const auto to_path = to_full_path(json::get_string_list(request, "to"));
-  if (std::filesystem::exists(from_path))
-    do_move_file(from_path, to_path);
+  start_file_job(response, "move",
+    [this, from_path, to_path, database = index_database()](FileOperationProgress& progress) {
+      if (!std::filesystem::exists(from_path))
+        return;
+      execute_file_operation(database, progress, false, [&]() {
+        move_files(from_path, to_path, progress);
+      });
+    });
 }
 
-void Logic::delete_file(Response&, const Request& request) {
+void Logic::delete_file(Response& response, const Request& request) {
   auto path = json::get_string_list(request, "path");
   const auto file_path = to_full_path(path);
   const auto undelete_id = json::try_get_string(request, "undeleteId");
   if (undelete_id) {
     path.insert(begin(path), { trash_directory_name, *undelete_id });
     const auto trash_path = to_full_path(path);
-    if (std::filesystem::exists(file_path))
-      do_move_file(file_path, trash_path);
+    start_file_job(response, "delete",
+      [this, file_path, trash_path, database = index_database()](FileOperationProgress& progress) {
+        if (!std::filesystem::exists(file_path))
+          return;
+        execute_file_operation(database, progress, true, [&]() {
+          move_files(file_path, trash_path, progress);
+        });
+      });
   }
   else {
-    if (std::filesystem::is_regular_file(file_path))
-      std::filesystem::remove(file_path);
-    else if (std::filesystem::is_directory(file_path))
-      std::filesystem::remove_all(file_path);
+    start_file_job(response, "delete",
+      [this, file_path, database = index_database()](FileOperationProgress& progress) {
+        if (!std::filesystem::exists(file_path))
+          return;
+        execute_file_operation(database, progress, false, [&]() {
+          remove_files(file_path, progress);
+        });
+      });
   }
 }
 
-void Logic::undelete_file(Response&, const Request& request) {
+void Logic::undelete_file(Response& response, const Request& request) {
   const auto undelete_id = json::get_string(request, "undeleteId");
   const auto trash_path = to_full_path({ trash_directory_name, undelete_id });
-  if (!std::filesystem::is_directory(trash_path))
+  start_file_job(response, "undelete",
+    [this, trash_path, library_root = m_library_root,
+     database = index_database()](FileOperationProgress& progress) {
+      if (!std::filesystem::is_directory(trash_path))
+        return;
+      // merge into library root
+      execute_file_operation(database, progress, false, [&]() {
+        move_files(trash_path, library_root, progress);
+        std::filesystem::remove_all(trash_path);
+      });
+    });
+}
+
+// the index only references the archives by path, so they do not need
+// to be reindexed. It is also updated for the completed part, when the
+// operation is cancelled or fails. Called by the file operation worker
+void Logic::execute_file_operation(const std::shared_ptr<Database>& database,
+    FileOperationProgress& progress, bool deleted,
+    const std::function<void()>& operation) {
+  const auto update_index = [&]() {
+    if (!database)
+      return;
+    try {
+      if (!progress.moved_paths.empty())
+        database->move_archives(progress.moved_paths, deleted);
+      if (!progress.removed_paths.empty())
+        release_blobs(*database,
+          database->remove_archives(progress.removed_paths));
+    }
+    catch (const std::exception&) {
+      // moved archives are still found by their uid when they are reindexed
+    }
+  };
+  try {
+    operation();
+  }
+  catch (...) {
+    update_index();
+    throw;
+  }
+  update_index();
+}
+
+BackgroundWorker& Logic::file_worker() {
+  if (!m_file_worker)
+    m_file_worker = std::make_unique<BackgroundWorker>();
+  return *m_file_worker;
+}
+
+void Logic::set_trash_policy(Response&, const Request& request) {
+  // omitted values are reset to unlimited
+  const auto get_limit = [&](const char* name) {
+    const auto value = json::try_get_int64(request, name);
+    return (value && *value > 0 ? static_cast<uint64_t>(*value) : 0);
+  };
+  m_trash_policy.max_age = std::chrono::milliseconds(get_limit("maxAge"));
+  m_trash_policy.max_size = get_limit("maxSize");
+  schedule_trash_collection();
+}
+
+void Logic::schedule_trash_collection() {
+  const auto policy = m_trash_policy;
+  if (m_library_root.empty() || (!policy.max_age.count() && !policy.max_size)) {
+    if (m_file_worker)
+      m_file_worker->set_idle_task(nullptr, { });
     return;
-  for (const auto& file : std::filesystem::directory_iterator(trash_path))
-    do_move_file(file.path(), m_library_root / relative(file.path(), trash_path));
-  std::filesystem::remove_all(trash_path);
+  }
+  // the worker outlives its idle task, file_worker() must not be called
+  // by the worker thread
+  auto& worker = file_worker();
+  worker.set_idle_task(
+    [this, &worker, trash_root = m_library_root / trash_directory_name, policy,
+     database = index_database()]() {
+      return collect_trash(worker, trash_root, policy, database);
+    }, trash_collection_idle_delay);
+}
+
+// each deleted file is in its own directory, which is created on deletion.
+// The sizes of unmodified entries are kept from the previous call
+void Logic::update_trash_entries(const std::filesystem::path& trash_root,
+    bool get_size) {
+  auto previous = std::map<std::filesystem::path, TrashEntry>();
+  for (auto& entry : m_trash_entries)
+    previous[entry.path] = std::move(entry);
+  m_trash_entries.clear();
+
+  auto error = std::error_code{ };
+  for (const auto& entry : std::filesystem::directory_iterator(trash_root, error)) {
+    auto trash_entry = TrashEntry{ entry.path(), entry.last_write_time(error), { } };
+    const auto it = previous.find(trash_entry.path);
+    if (it != previous.end() && it->second.deletion_time == trash_entry.deletion_time)
+      trash_entry.size = it->second.size;
+    if (get_size && !trash_entry.size) {
+      auto size = uint64_t{ };
+      for (auto file = std::filesystem::recursive_directory_iterator(entry.path(), error);
+           file != std::filesystem::recursive_directory_iterator(); file.increment(error))
+        if (file->is_regular_file(error))
+          size += file->file_size(error);
+      trash_entry.size = size;
+    }
+    m_trash_entries.push_back(std::move(trash_entry));
+  }
+  std::sort(m_trash_entries.begin(), m_trash_entries.end(),
+    [](const TrashEntry& a, const TrashEntry& b) {
+      return a.deletion_time < b.deletion_time;
+    });
+}
+
+// called by the file worker while it is idle. Removes the oldest deleted
+// file exceeding the budgets, returns true when it should be called again
+bool Logic::collect_trash(BackgroundWorker& worker,
+    const std::filesystem::path& trash_root,
+    TrashPolicy policy, const std::shared_ptr<Database>& database) {
+  update_trash_entries(trash_root, policy.max_size != 0);
+  if (m_trash_entries.empty())
+    return false;
+
+  auto total_size = uint64_t{ };
+  for (const auto& entry : m_trash_entries)
+    total_size += entry.size.value_or(0);
+  const auto& oldest = m_trash_entries.front();
+  const auto age = std::filesystem::file_time_type::clock::now() - oldest.deletion_time;
+  const auto expired = (policy.max_age.count() && age >= policy.max_age);
+  const auto oversized = (policy.max_size && total_size > policy.max_size);
+  if (!expired && !oversized) {
+    // check again when the oldest file expires
+    if (policy.max_age.count())
+      worker.schedule_idle_task(std::chrono::steady_clock::now() +
+        std::chrono::ceil<std::chrono::milliseconds>(policy.max_age - age));
+    return false;
+  }
+
+  try {
+    execute_file_operation(database, m_trash_collection_progress, false, [&]() {
+      remove_files(oldest.path, m_trash_collection_progress);
+    });
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+// the index may be outdated, so the blobs are only removed when no archive
+// in the library or the trash references them
+void Logic::release_blobs(Database& database,
+    const std::vector<std::string>& hashes) {
+  if (hashes.empty())
+    return;
+  const auto& library_root = database.library_root();
+  auto archives = std::vector<std::filesystem::path>();
+  for (const auto& root : { library_root, library_root / trash_directory_name })
+    for (const auto& file : scan_library(root, library_scan_threads))
+      archives.push_back(root / file.filename);
+  remove_blobs(get_blob_store_path(library_root), archives, hashes,
+    blob_release_grace_period);
+}
+
+// the references of a finished recording are recorded before it is indexed
+void Logic::record_blob_references(int recording_id) {
+  const auto it = m_blob_store_recordings.find(recording_id);
+  if (it == m_blob_store_recordings.end())
+    return;
+  background_worker().execute([this, filename = it->second,
+                               database = index_database()]() {
+    if (database)
+      release_blobs(*database, database->record_blob_references(filename));
+  });
+  m_blob_store_recordings.erase(it);
+}
+
+void Logic::start_file_job(Response& response, std::string action,
+    std::function<void(FileOperationProgress&)> operation) {
+  auto lock = std::unique_lock(m_file_jobs_mutex);
+  const auto id = m_next_file_job_id++;
+  const auto job = std::make_shared<FileJob>();
+  job->action = std::move(action);
+  job->state = "queued";
+  m_file_jobs[id] = job;
+  lock.unlock();
+
+  // executed one after another in order of request
+  file_worker().execute([this, job, operation = std::move(operation)]() {
+    auto lock = std::unique_lock(m_file_jobs_mutex);
+    if (job->progress.cancelled) {
+      job->state = "cancelled";
+      return;
+    }
+    job->state = "running";
+    lock.unlock();
+
+    auto state = "completed";
+    auto error = std::string();
+    try {
+      operation(job->progress);
+    }
+    catch (const FileOperationCancelled&) {
+      state = "cancelled";
+    }
+    catch (const std::exception& ex) {
+      state = "failed";
+      error = ex.what();
+    }
+    invalidate_library_listing();
+    lock.lock();
+    job->state = state;
+    job->error = std::move(error);
+  });
+
+  response.Key("jobId");
+  response.Int(id);
+}
+
+void Logic::get_file_operation(Response& response, const Request& request) {
+  const auto id = json::get_int(request, "jobId");
+  auto lock = std::lock_guard(m_file_jobs_mutex);
+  const auto it = m_file_jobs.find(id);
+  if (it == m_file_jobs.end())
+    throw std::runtime_error("unknown file operation");
+  const auto& job = *it->second;
+
+  // forget job, once its result was reported
+  if (job.state == "failed") {
+    const auto error = job.error;
+    m_file_jobs.erase(it);
+    throw std::runtime_error(error);
+  }
+  response.Key("action");
+  response.String(job.action);
+  response.Key("state");
+  response.String(job.state);
+  response.Key("totalFiles");
+  response.Uint64(job.progress.total_files);
+  response.Key("processedFiles");
+  response.Uint64(job.progress.processed_files);
+  response.Key("copiedBytes");
+  response.Uint64(job.progress.copied_bytes);
+  if (job.state == "completed" || job.state == "cancelled")
+    m_file_jobs.erase(it);
+}
+
+void Logic::cancel_file_operation(Response&, const Request& request) {
+  const auto id = json::get_int(request, "jobId");
+  auto lock = std::lock_guard(m_file_jobs_mutex);
+  if (auto it = m_file_jobs.find(id); it != m_file_jobs.end())
+    it->second->progress.cancelled = true;
+}
+
+void Logic::cancel_file_jobs() {
+  auto lock = std::unique_lock(m_file_jobs_mutex);
+  for (const auto& [id, job] : m_file_jobs)
+    job->progress.cancelled = true;
+  lock.unlock();
+  m_trash_collection_progress.cancelled = true;
+  m_file_worker.reset();
 }
 
 void Logic::start_recording(Response&, const Request& request) {
@@ -144,35 +412,349 @@ void Logic::start_recording(Response&, const Request& request) {
       "--block-hosts-file", '\"' + path_to_utf8(m_block_hosts_file) + '\"',
     });
 
-  m_webrecorders.emplace(std::piecewise_construct,
-    std::forward_as_tuple(id),
-    std::forward_as_tuple(std::move(arguments), path_to_utf8(path.parent_path())));
+  if (m_blob_store) {
+    const auto blob_store = get_blob_store_path(m_library_root);
+    create_directories_handle_symlinks(blob_store);
+    arguments.insert(end(arguments), {
+      "--blob-store", '\"' + path_to_utf8(blob_store) + '\"',
+    });
+    m_blob_store_recordings[id] = path;
+  }
+
+  auto working_directory = path_to_utf8(path.parent_path());
+  if (count_running_recordings() < m_max_recordings &&
+      m_queued_recordings.empty()) {
+    start_webrecorder(id, arguments, working_directory);
+  }
+  else {
+    const auto foreground = json::try_get_bool(request, "foreground").value_or(false);
+    m_queued_recordings.push_back({ id, std::move(arguments),
+      std::move(working_directory), foreground, false });
+    // slots may have become free since the last poll
+    start_queued_recordings();
+  }
 }
 
 void Logic::stop_recording(Response&, const Request& request) {
   const auto id = json::get_int(request, "id");
   if (auto it = m_webrecorders.find(id); it != m_webrecorders.end())
-    it->second.stop();
+    it->second->stop();
+
+  m_queued_recordings.erase(std::remove_if(
+    m_queued_recordings.begin(), m_queued_recordings.end(),
+    [&](const QueuedRecording& recording) { return recording.id == id; }),
+    m_queued_recordings.end());
+  if (!m_webrecorders.count(id))
+    m_blob_store_recordings.erase(id);
 }
 
 void Logic::get_recording_output(Response& response, const Request& request) {
   const auto id = json::get_int(request, "id");
-  if (auto it = m_webrecorders.find(id); it != m_webrecorders.end()) {
-    response.Key("events");
+  start_queued_recordings();
+
+  for (auto& recording : m_queued_recordings)
+    if (recording.id == id) {
+      write_queued_recording_output(response, recording);
+      return;
+    }
+
+  if (auto it = m_webrecorders.find(id); it != m_webrecorders.end())
+    if (write_recording_output(response, *it->second)) {
+      // cleanup stopped recorder
+      m_webrecorders.erase(it);
+      record_blob_references(id);
+      invalidate_library_listing();
+    }
+}
+
+void Logic::get_all_recording_output(Response& response, const Request&) {
+  start_queued_recordings();
+
+  response.Key("recordings");
+  response.StartArray();
+  for (auto& recording : m_queued_recordings) {
+    response.StartObject();
+    response.Key("id");
+    response.Int(recording.id);
+    write_queued_recording_output(response, recording);
+    response.EndObject();
+  }
+  auto finished = std::vector<int>();
+  for (auto it = m_webrecorders.begin(); it != m_webrecorders.end(); ) {
+    response.StartObject();
+    response.Key("id");
+    response.Int(it->first);
+    const auto complete = write_recording_output(response, *it->second);
+    response.EndObject();
+    if (complete) {
+      finished.push_back(it->first);
+      record_blob_references(it->first);
+      invalidate_library_listing();
+      it = m_webrecorders.erase(it);
+      continue;
+    }
+    ++it;
+  }
+  response.EndArray();
+
+  response.Key("finished");
+  response.StartArray();
+  for (auto id : finished)
+    response.Int(id);
+  response.EndArray();
+}
+
+void Logic::write_queued_recording_output(Response& response,
+    QueuedRecording& recording) {
+  response.Key("events");
+  response.StartArray();
+  if (!std::exchange(recording.reported, true))
+    response.String("QUEUED");
+  response.EndArray();
+}
+
+bool Logic::write_recording_output(Response& response, Webrecorder& webrecorder) {
+  // when it finished before, all its output is written
+  const auto finished = webrecorder.finished();
+
+  // before the output is read, so an exceeded limit is reported right away
+  const auto sampled = webrecorder.update_stats(recorder_stats_interval);
+  enforce_recorder_limits(webrecorder);
+
+  response.Key("events");
+  response.StartArray();
+  auto dropped = webrecorder.for_each_output_line([&](const auto& line) {
+    response.String(line.data(), static_cast<json::size_t>(line.size()));
+  });
+  response.EndArray();
+
+  // events of the event channel as [type, status, size, url]
+  auto has_event_frames = false;
+  dropped += webrecorder.for_each_event([&](const EventFrameBuffer::Event& event) {
+    if (!std::exchange(has_event_frames, true)) {
+      response.Key("eventFrames");
+      response.StartArray();
+    }
     response.StartArray();
-    it->second.for_each_output_line([&](const auto& line) {
-      response.String(line.data(), static_cast<json::size_t>(line.size()));
-    });
+    response.String(event.type.data(), static_cast<json::size_t>(event.type.size()));
+    response.Uint(event.status);
+    response.Uint64(event.size);
+    response.String(event.url);
+    response.EndArray();
+  });
+  if (has_event_frames)
     response.EndArray();
 
-    // cleanup stopped recorder
-    if (it->second.finished()) {
-      m_webrecorders.erase(it);
+  if (dropped) {
+    response.Key("droppedEvents");
+    response.Uint64(dropped);
+  }
+
+  if (sampled) {
+    response.Key("stats");
+    response.StartObject();
+    write_recorder_stats(response, webrecorder);
+    response.EndObject();
+  }
+  return finished;
+}
+
+void Logic::set_recording_policy(Response&, const Request& request) {
+  // omitted value is reset to its default
+  const auto max_recordings = json::try_get_int(request, "maxRecordings");
+  m_max_recordings = (max_recordings && *max_recordings > 0 ?
+    static_cast<size_t>(*max_recordings) : default_max_recordings);
+
+  // pool is disabled by default
+  const auto warm_recorders = json::try_get_int(request, "warmRecorders");
+  m_warm_recorder_count = (warm_recorders && *warm_recorders > 0 ?
+    static_cast<size_t>(*warm_recorders) : 0);
+  if (m_warm_recorders.size() > m_warm_recorder_count)
+    m_warm_recorders.resize(m_warm_recorder_count);
+
+  // requires a webrecorder supporting --event-fd
+  const auto event_channel = json::try_get_bool(request, "eventChannel").value_or(false);
+  if (event_channel != m_event_channel) {
+    m_event_channel = event_channel;
+    m_warm_recorders.clear();
+  }
+
+  // requires a webrecorder supporting --blob-store
+  m_blob_store = json::try_get_bool(request, "blobStore").value_or(false);
+
+  const auto get_limit = [&](const char* name) {
+    const auto value = json::try_get_int64(request, name);
+    return (value && *value > 0 ? static_cast<uint64_t>(*value) : 0);
+  };
+  m_recorder_limits.max_memory = get_limit("maxRecorderMemory");
+  m_recorder_limits.max_written_bytes = get_limit("maxRecorderWrittenBytes");
+  m_recorder_limits.max_running_time =
+    std::chrono::milliseconds(get_limit("maxRecorderTime"));
+
+  start_queued_recordings();
+  fill_warm_pool();
+}
+
+void Logic::prioritize_recording(Response&, const Request& request) {
+  const auto id = json::get_int(request, "id");
+  for (auto& recording : m_queued_recordings)
+    recording.foreground = (recording.id == id);
+}
+
+void Logic::get_recorders(Response& response, const Request&) {
+  response.Key("recorders");
+  response.StartArray();
+  for (const auto& recording : m_queued_recordings) {
+    response.StartObject();
+    response.Key("id");
+    response.Int(recording.id);
+    response.Key("state");
+    response.String("queued");
+    response.EndObject();
+  }
+  for (const auto& [id, webrecorder] : m_webrecorders) {
+    webrecorder->update_stats(recorder_stats_interval);
+    response.StartObject();
+    response.Key("id");
+    response.Int(id);
+    response.Key("state");
+    response.String(webrecorder->finished() ? "finished" : "running");
+    write_recorder_stats(response, *webrecorder);
+    response.EndObject();
+    enforce_recorder_limits(*webrecorder);
+  }
+  response.EndArray();
+}
+
+void Logic::write_recorder_stats(Response& response, const Webrecorder& webrecorder) {
+  response.Key("runningTime");
+  response.Int64(std::chrono::duration_cast<std::chrono::milliseconds>(
+    webrecorder.running_time()).count());
+
+  if (const auto& stats = webrecorder.stats()) {
+    response.Key("cpuTime");
+    response.Int64(stats->cpu_time.count());
+    response.Key("memory");
+    response.Uint64(stats->memory);
+    response.Key("readBytes");
+    response.Uint64(stats->read_bytes);
+    response.Key("writtenBytes");
+    response.Uint64(stats->written_bytes);
+  }
+}
+
+void Logic::enforce_recorder_limits(Webrecorder& webrecorder) {
+  if (webrecorder.stopping())
+    return;
+
+  const auto& limits = m_recorder_limits;
+  const auto& stats = webrecorder.stats();
+  const auto exceeded = [&]() -> const char* {
+    if (limits.max_running_time.count() &&
+        webrecorder.running_time() > limits.max_running_time)
+      return "time";
+    if (stats && limits.max_memory && stats->memory > limits.max_memory)
+      return "memory";
+    if (stats && limits.max_written_bytes &&
+        stats->written_bytes > limits.max_written_bytes)
+      return "size";
+    return nullptr;
+  }();
+  if (exceeded) {
+    webrecorder.append_event(std::string("LIMIT_EXCEEDED ") + exceeded);
+    webrecorder.stop();
+  }
+}
+
+size_t Logic::count_running_recordings() const {
+  return static_cast<size_t>(std::count_if(
+    m_webrecorders.begin(), m_webrecorders.end(),
+    [](const auto& webrecorder) { return !webrecorder.second->finished(); }));
+}
+
+void Logic::start_queued_recordings() {
+  auto running = count_running_recordings();
+  while (running < m_max_recordings && !m_queued_recordings.empty()) {
+    // recordings of foreground tabs first, otherwise in order of request
+    auto it = std::find_if(m_queued_recordings.begin(), m_queued_recordings.end(),
+      [](const QueuedRecording& recording) { return recording.foreground; });
+    if (it == m_queued_recordings.end())
+      it = m_queued_recordings.begin();
+    auto recording = std::move(*it);
+    m_queued_recordings.erase(it);
+
+    // a recording which fails to start appears finished when polled
+    try {
+      start_webrecorder(recording.id,
+        recording.arguments, recording.working_directory);
+      ++running;
+    }
+    catch (const std::exception&) {
+    }
+  }
+}
+
+void Logic::start_webrecorder(int id, const std::vector<std::string>& arguments,
+    const std::string& working_directory) {
+  if (m_webrecorders.count(id))
+    return;
+
+  // prefer a pre-started webrecorder, which completed the handshake
+  for (auto it = m_warm_recorders.begin(); it != m_warm_recorders.end(); ) {
+    auto& webrecorder = *it;
+    if (webrecorder->assign(arguments, working_directory)) {
+      m_webrecorders.emplace(id, std::move(webrecorder));
+      m_warm_recorders.erase(it);
+      fill_warm_pool();
       return;
     }
+    if (webrecorder->finished()) {
+      // webrecorder does not support control mode
+      m_warm_recorders_unsupported = true;
+      it = m_warm_recorders.erase(it);
+      continue;
+    }
+    ++it;
+  }
+  m_webrecorders.emplace(id,
+    std::make_unique<Webrecorder>(arguments, working_directory, m_event_channel));
+}
+
+void Logic::fill_warm_pool() {
+  while (!m_warm_recorders_unsupported &&
+         m_warm_recorders.size() < m_warm_recorder_count) {
+    try {
+      m_warm_recorders.push_back(std::make_unique<Webrecorder>(
+        path_to_utf8(webrecorder_path()), m_event_channel));
+    }
+    catch (const std::exception&) {
+      m_warm_recorders_unsupported = true;
+    }
   }
 }
 
+void Logic::stop_all_recordings() {
+  m_queued_recordings.clear();
+
+  // let all recorders finish writing their archives in parallel
+  auto webrecorders = std::vector<Webrecorder*>();
+  for (const auto& [id, webrecorder] : m_webrecorders)
+    webrecorders.push_back(webrecorder.get());
+  for (const auto& webrecorder : m_warm_recorders)
+    webrecorders.push_back(webrecorder.get());
+
+  for (auto webrecorder : webrecorders)
+    webrecorder->stop();
+
+  const auto deadline = std::chrono::steady_clock::now() + recorder_shutdown_timeout;
+  for (auto webrecorder : webrecorders)
+    if (!webrecorder->wait_until_finished(deadline))
+      webrecorder->kill();
+
+  m_webrecorders.clear();
+  m_warm_recorders.clear();
+}
+
 void Logic::set_library_root(Response& response, const Request& request) {
   const auto path = json::try_get_string(request, "path");
   auto library_root = std::filesystem::u8path(path.value_or("")).lexically_normal();
@@ -185,7 +767,13 @@ void Logic::set_library_root(Response& response, const Request& request) {
     create_directories_handle_symlinks(library_root);
   }
   // succeeded
-  m_library_root = library_root;
+  if (library_root != m_library_root) {
+    m_library_watcher.reset();
+    reset_database();
+    m_library_root = library_root;
+    watch_library();
+    schedule_trash_collection();
+  }
 
   response.Key("path");
   response.String(path_to_utf8(library_root));
@@ -193,31 +781,76 @@ void Logic::set_library_root(Response& response, const Request& request) {
 
 void Logic::get_library_listing(Response& response,
     [[maybe_unused]] const Request& request) {
-  const auto options =
-    std::filesystem::directory_options::follow_directory_symlink |
-    std::filesystem::directory_options::skip_permission_denied;
-  auto error = std::error_code{ };
   response.Key("files");
   response.StartArray();
-  for (const auto& entry : std::filesystem::recursive_directory_iterator(
-                             m_library_root, options, error))
-    if (entry.is_regular_file()) {
-      auto reader = ArchiveReader();
-      if (reader.open_root(entry.path())) {
-        auto url = reader.read("url");
-        if (!url.empty()) {
-          response.StartObject();
-          response.Key("filename");
-          response.String(path_to_utf8(relative(entry.path(), m_library_root)));
-          response.Key("url");
-          response.String(std::string(as_string_view(url)));
-          response.EndObject();
-        }
-      }
-    }
+  for (const auto& file : get_library_files()) {
+    response.StartObject();
+    response.Key("filename");
+    response.String(path_to_utf8(file.filename));
+    response.Key("url");
+    response.String(file.url);
+    response.EndObject();
+  }
   response.EndArray();
 }
 
+// called when the library was modified by the host itself,
+// without waiting for the watcher to report the changes
+void Logic::invalidate_library_listing() {
+  auto lock = std::lock_guard(m_library_mutex);
+  m_library_listing.reset();
+  ++m_library_generation;
+}
+
+void Logic::watch_library() {
+  invalidate_library_listing();
+
+  // the watcher's callback must not create the background worker
+  background_worker();
+  m_library_watcher = std::make_unique<LibraryWatcher>(m_library_root,
+    [this](const LibraryWatcher::Changes& changes) { library_changed(changes); });
+}
+
+// called by the watcher's thread
+void Logic::library_changed(const LibraryWatcher::Changes& changes) {
+  auto existing_paths = std::vector<std::filesystem::path>();
+  auto changed_paths = std::vector<std::filesystem::path>();
+  auto error = std::error_code{ };
+  for (const auto& path : changes.paths) {
+    if (std::filesystem::exists(path, error))
+      existing_paths.push_back(path);
+    changed_paths.push_back(path.lexically_relative(m_library_root));
+  }
+  auto files = scan_library(m_library_root, existing_paths, library_scan_threads);
+
+  auto lock = std::unique_lock(m_library_mutex);
+  ++m_library_generation;
+  if (changes.overflow)
+    m_library_listing.reset();
+  else if (m_library_listing)
+    update_library_files(*m_library_listing, changed_paths, files);
+  lock.unlock();
+
+  for (const auto& file : files)
+    queue_index_update(m_library_root / file.filename, false);
+}
+
+std::vector<LibraryFile> Logic::get_library_files() {
+  auto lock = std::unique_lock(m_library_mutex);
+  if (m_library_listing)
+    return *m_library_listing;
+
+  // listing can be cached, when the watcher keeps it up to date
+  const auto cache = (m_library_watcher && m_library_watcher->watching());
+  const auto generation = m_library_generation;
+  lock.unlock();
+  auto files = scan_library(m_library_root, library_scan_threads);
+  lock.lock();
+  if (cache && generation == m_library_generation)
+    m_library_listing = files;
+  return files;
+}
+
 void Logic::browse_directories(Response& response, const Request& request) {
   auto initial_path = std::string();
   if (const auto path = json::try_get_string(request, "path"))
@@ -279,6 +912,31 @@ void Logic::get_file_listing(Response& response, const Request& request) {
       response.Int64(file.modification_time);
       response.EndObject();
     });
+
+    // files in the blob store are shared with other archives
+    const auto blob_store = get_blob_store_path(m_library_root);
+    const auto recording_time = reader.get_file_info("url");
+    for (const auto& reference : get_blob_references(reader)) {
+      const auto blob_path = get_blob_path(blob_store, reference.hash);
+      auto error = std::error_code{ };
+      const auto size = std::filesystem::file_size(blob_path, error);
+      if (error)
+        continue;
+      response.StartObject();
+      response.String("url");
+      response.String(reference.url);
+      response.String("compressedSize");
+      response.Uint64(size);
+      response.String("uncompressedSize");
+      response.Uint64(size);
+      response.String("modificationTime");
+      response.Int64(recording_time ? recording_time->modification_time : 0);
+      response.String("blob");
+      response.String(reference.hash);
+      response.String("references");
+      response.Int64(database()->get_blob_reference_count(reference.hash));
+      response.EndObject();
+    }
     response.EndArray();
   }
 }
@@ -289,40 +947,228 @@ BackgroundWorker& Logic::background_worker() {
   return *m_background_worker;
 }
 
-Database& Logic::database() {
+// tasks keep the database of the library root at the time they were queued
+std::shared_ptr<Database> Logic::database() {
+  auto lock = std::lock_guard(m_database_mutex);
   if (m_library_root.empty())
     throw std::runtime_error("library root not set");
-  if (!m_database)
-    m_database = std::make_unique<Database>(m_library_root / index_database_filename);
-  return *m_database;
+  if (!m_database) {
+    m_database = std::make_shared<Database>(m_library_root / index_database_filename);
+    background_worker().set_idle_task(
+      [database = m_database]() { return database->merge_index(); },
+      index_merge_idle_delay);
+  }
+  return m_database;
+}
+
+// the index is optional for maintaining the library
+std::shared_ptr<Database> Logic::index_database() {
+  try {
+    return database();
+  }
+  catch (const std::exception&) {
+    return nullptr;
+  }
+}
+
+void Logic::reset_database() {
+  auto lock = std::lock_guard(m_database_mutex);
+  if (m_database && m_background_worker)
+    m_background_worker->set_idle_task(nullptr, { });
+  m_database.reset();
+}
+
+void Logic::queue_index_update(std::filesystem::path filename, bool reindex) {
+  // coalesce repeated updates of an archive
+  auto lock = std::unique_lock(m_library_mutex);
+  const auto [it, inserted] = m_pending_index_updates.emplace(filename, reindex);
+  it->second |= reindex;
+  if (!inserted)
+    return;
+  lock.unlock();
+
+  background_worker().execute([this, filename = std::move(filename),
+                                database = index_database()]() {
+    auto lock = std::unique_lock(m_library_mutex);
+    const auto it = m_pending_index_updates.find(filename);
+    const auto reindex = it->second;
+    m_pending_index_updates.erase(it);
+    const auto policy = m_indexing_policy;
+    lock.unlock();
+    if (database)
+      release_blobs(*database,
+        database->update_index(filename, policy, reindex));
+  });
+}
+
+void Logic::set_indexing_policy(Response&, const Request& request) {
+  // omitted values are reset to their defaults
+  const auto get_limit = [&](const char* name, auto default_value) {
+    const auto value = json::try_get_int64(request, name);
+    return (value && *value >= 0 ?
+      static_cast<decltype(default_value)>(*value) : default_value);
+  };
+  const auto& defaults = default_indexing_policy;
+  auto policy = IndexingPolicy{ };
+  policy.max_pages = get_limit("maxPages", defaults.max_pages);
+  policy.max_bytes = get_limit("maxBytes", defaults.max_bytes);
+  policy.max_text_length = get_limit("maxTextLength", defaults.max_text_length);
+  policy.max_document_size = get_limit("maxDocumentSize", defaults.max_document_size);
+  policy.max_extraction_time = get_limit("maxExtractionTime", defaults.max_extraction_time);
+
+  auto lock = std::lock_guard(m_library_mutex);
+  m_indexing_policy = policy;
 }
 
 void Logic::update_search_index(Response&, const Request& request) {
-  const auto path = to_full_path(json::get_string_list(request, "path"));
-  background_worker().execute(std::bind(&Database::update_index, &database(), path));
+  queue_index_update(to_full_path(json::get_string_list(request, "path")), true);
+}
+
+void Logic::optimize_search_index(Response&, const Request&) {
+  background_worker().execute(std::bind(&Database::optimize_index, database()));
+}
+
+void Logic::vacuum_search_index(Response&, const Request&) {
+  background_worker().execute(std::bind(&Database::vacuum_index, database()));
+}
+
+void Logic::get_search_index_metrics(Response& response, const Request&) {
+  const auto metrics = database()->get_metrics();
+  response.Key("metrics");
+  response.StartObject();
+  response.String("pageCount");
+  response.Int64(metrics.page_count);
+  response.String("segmentCount");
+  response.Int64(metrics.segment_count);
+  response.String("databaseSize");
+  response.Int64(metrics.database_size);
+  response.String("skippedPageCount");
+  response.Int64(metrics.skipped_page_count);
+  response.String("skippedByteCount");
+  response.Int64(metrics.skipped_byte_count);
+  response.String("truncatedPageCount");
+  response.Int64(metrics.truncated_page_count);
+  response.EndObject();
+
+  response.Key("indexingPolicy");
+  response.StartObject();
+  response.String("maxPages");
+  response.Uint64(m_indexing_policy.max_pages);
+  response.String("maxBytes");
+  response.Uint64(m_indexing_policy.max_bytes);
+  response.String("maxTextLength");
+  response.Uint64(m_indexing_policy.max_text_length);
+  response.String("maxDocumentSize");
+  response.Uint64(m_indexing_policy.max_document_size);
+  response.String("maxExtractionTime");
+  response.Int64(m_indexing_policy.max_extraction_time.count());
+  response.EndObject();
+}
+
+Logic::SearchSession& Logic::search_session(const Request& request) {
+  const auto name = json::try_get_string(request, "session").value_or("");
+  auto lock = std::lock_guard(m_search_sessions_mutex);
+  auto it = m_search_sessions.find(name);
+  if (it == m_search_sessions.end())
+    it = m_search_sessions.emplace(std::piecewise_construct,
+      std::forward_as_tuple(name), std::forward_as_tuple()).first;
+  return it->second;
 }
 
 void Logic::execute_search(Response& response, const Request& request) {
+  // a search is superseded, when a newer one of the same session was received,
+  // handled before anything which can throw
+  auto& session = search_session(request);
+  const auto generation = ++session.handled;
+  const auto superseded = [&]() { return (session.received > generation); };
+
   const auto query = json::get_string(request, "query");
-  const auto highlight = json::try_get_bool(request, "highlight").value_or(false);
-  const auto snippet_size = json::try_get_int(request, "snippetSize").value_or(16);
-  const auto max_count = json::try_get_int(request, "maxCount").value_or(5);
+  auto options = SearchOptions();
+  if (auto folder = json::try_get_string_list(request, "folder"); folder && !folder->empty())
+    options.filter.folder = to_full_path(*folder)
+      .lexically_relative(m_library_root).generic_u8string();
+  if (auto hostname = json::try_get_string(request, "hostname"))
+    options.filter.hostname = std::string(*hostname);
+  // times in milliseconds since the epoch like the other times, the
+  // index stores seconds. Rounded up, as only the lower bound is inclusive
+  const auto to_seconds = [](int64_t milliseconds) {
+    return (milliseconds > 0 ? (milliseconds + 999) / 1000 : milliseconds / 1000);
+  };
+  if (auto time_from = json::try_get_int64(request, "timeFrom"))
+    options.filter.time_from = to_seconds(*time_from);
+  if (auto time_to = json::try_get_int64(request, "timeTo"))
+    options.filter.time_to = to_seconds(*time_to);
+  options.weights.title = json::try_get_double(request, "titleWeight").value_or(10.0);
+  options.weights.heading = json::try_get_double(request, "headingWeight").value_or(5.0);
+  options.weights.text = json::try_get_double(request, "textWeight").value_or(1.0);
+  options.weights.navigation = json::try_get_double(request, "navigationWeight").value_or(0.2);
+  options.highlight = json::try_get_bool(request, "highlight").value_or(false);
+  options.snippet_size = json::try_get_int(request, "snippetSize").value_or(16);
+  options.offset = json::try_get_int(request, "offset").value_or(0);
+  options.max_count = json::try_get_int(request, "maxCount").value_or(5);
+  options.max_facet_values = json::try_get_int(request, "maxFacetValues").value_or(10);
+  if (auto facets = json::try_get_string_list(request, "facets"))
+    options.facets.assign(facets->begin(), facets->end());
+
+  const auto results = (!superseded() ?
+    database()->execute_search(query, options, superseded) :
+    std::optional<SearchResults>());
+
+  const auto write_string = [&](const std::string& string) {
+    response.String(string.data(), static_cast<json::size_t>(string.size()));
+  };
+
   response.Key("matches");
   response.StartArray();
-  database().execute_search(query, highlight, snippet_size, max_count,
-    [&](SearchResult r) {
+  if (results)
+    for (const auto& match : results->matches) {
       response.StartObject();
       response.String("uid");
-      response.Int64(r.uid);
+      response.Int64(match.uid);
       response.String("url");
-      response.String(r.url.data(), static_cast<json::size_t>(r.url.size()));
+      write_string(match.url);
       response.String("title");
-      response.String(r.title.data(), static_cast<json::size_t>(r.title.size()));
+      write_string(match.title);
       response.String("snippet");
-      response.String(r.snippet.data(), static_cast<json::size_t>(r.snippet.size()));
+      write_string(match.snippet);
       response.EndObject();
-    });
+    }
   response.EndArray();
+
+  if (!results) {
+    response.Key("cancelled");
+    response.Bool(true);
+    return;
+  }
+
+  response.Key("totalCount");
+  response.Int64(results->total_count);
+  response.Key("totalCountExact");
+  response.Bool(results->total_count_exact);
+
+  if (!results->facets.empty()) {
+    response.Key("facets");
+    response.StartObject();
+    for (const auto& facet : results->facets) {
+      response.Key(facet.name.data(), static_cast<json::size_t>(facet.name.size()));
+      response.StartArray();
+      for (const auto& [value, count] : facet.values) {
+        response.StartObject();
+        response.String("value");
+        write_string(value);
+        response.String("count");
+        response.Int64(count);
+        response.EndObject();
+      }
+      response.EndArray();
+    }
+    response.EndObject();
+  }
+}
+
+void Logic::request_received(const Request& request) {
+  if (json::try_get_string(request, "action") == "executeSearch")
+    ++search_session(request).received;
 }
 
 void Logic::handle_request(Response& response, const Request& request) {
@@ -332,9 +1178,16 @@ void Logic::handle_request(Response& response, const Request& request) {
     { "moveFile", &Logic::move_file },
     { "deleteFile", &Logic::delete_file },
     { "undeleteFile", &Logic::undelete_file },
+    { "getFileOperation", &Logic::get_file_operation },
+    { "cancelFileOperation", &Logic::cancel_file_operation },
+    { "setTrashPolicy", &Logic::set_trash_policy },
     { "startRecording", &Logic::start_recording },
     { "stopRecording", &Logic::stop_recording },
     { "getRecordingOutput", &Logic::get_recording_output },
+    { "setRecordingPolicy", &Logic::set_recording_policy },
+    { "prioritizeRecording", &Logic::prioritize_recording },
+    { "getRecorders", &Logic::get_recorders },
+    { "getAllRecordingOutput", &Logic::get_all_recording_output },
     { "setLibraryRoot", &Logic::set_library_root },
     { "getLibraryListing", &Logic::get_library_listing },
     { "browserDirectories", &Logic::browse_directories },
@@ -342,7 +1195,11 @@ void Logic::handle_request(Response& response, const Request& request) {
     { "setBlockHostsList", &Logic::set_block_hosts_list },
     { "getFileSize", &Logic::get_file_size },
     { "getFileListing", &Logic::get_file_listing },
+    { "setIndexingPolicy", &Logic::set_indexing_policy },
     { "updateSearchIndex", &Logic::update_search_index },
+    { "optimizeIndex", &Logic::optimize_search_index },
+    { "vacuumIndex", &Logic::vacuum_search_index },
+    { "getIndexMetrics", &Logic::get_search_index_metrics },
     { "executeSearch", &Logic::execute_search },
   };
   const auto action = json::get_string(request, "action");
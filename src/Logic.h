@@ -3,7 +3,16 @@
 #include "Settings.h"
 #include "Webrecorder.h"
 #include "Json.h"
+#include "Indexing.h"
+#include "LibraryScan.h"
+#include "LibraryWatcher.h"
+#include "FileOperations.h"
+#include <atomic>
+#include <deque>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <set>
 
 using Response = json::Writer;
 using Request = json::Document;
@@ -18,18 +27,96 @@ public:
   ~Logic();
 
   void handle_request(Response& response, const Request& request);
+  void request_received(const Request& request);
 
 private:
+  struct QueuedRecording {
+    int id;
+    std::vector<std::string> arguments;
+    std::string working_directory;
+    bool foreground;
+    bool reported;
+  };
+
+  struct RecorderLimits {
+    // zero means unlimited
+    uint64_t max_memory;
+    uint64_t max_written_bytes;
+    std::chrono::milliseconds max_running_time;
+  };
+
+  struct FileJob {
+    std::string action;
+    FileOperationProgress progress;
+    // guarded by m_file_jobs_mutex
+    std::string state;
+    std::string error;
+  };
+
+  struct TrashPolicy {
+    // zero means unlimited
+    std::chrono::milliseconds max_age;
+    uint64_t max_size;
+  };
+
+  struct TrashEntry {
+    std::filesystem::path path;
+    std::filesystem::file_time_type deletion_time;
+    std::optional<uint64_t> size;
+  };
+
+  struct SearchSession {
+    std::atomic<uint64_t> received{ };
+    uint64_t handled{ };
+  };
+
   std::filesystem::path to_full_path(const std::vector<std::string_view>& strings) const;
   void get_status(Response& response, const Request&);
   void move_file(Response&, const Request& request);
   void delete_file(Response&, const Request& request);
   void undelete_file(Response&, const Request& request);
+  void start_file_job(Response& response, std::string action,
+    std::function<void(FileOperationProgress&)> operation);
+  void get_file_operation(Response& response, const Request& request);
+  void cancel_file_operation(Response&, const Request& request);
+  void cancel_file_jobs();
+  void execute_file_operation(const std::shared_ptr<Database>& database,
+    FileOperationProgress& progress, bool deleted,
+    const std::function<void()>& operation);
+  void release_blobs(Database& database, const std::vector<std::string>& hashes);
+  void record_blob_references(int recording_id);
+  BackgroundWorker& file_worker();
+  void set_trash_policy(Response&, const Request& request);
+  void schedule_trash_collection();
+  void update_trash_entries(const std::filesystem::path& trash_root,
+    bool get_size);
+  bool collect_trash(BackgroundWorker& worker,
+    const std::filesystem::path& trash_root, TrashPolicy policy,
+    const std::shared_ptr<Database>& database);
   void start_recording(Response& response, const Request& request);
   void stop_recording(Response&, const Request& request);
   void get_recording_output(Response& response, const Request& request);
+  void get_all_recording_output(Response& response, const Request&);
+  void write_queued_recording_output(Response& response, QueuedRecording& recording);
+  // returns true when the recorder finished and all its output was written
+  bool write_recording_output(Response& response, Webrecorder& webrecorder);
+  void set_recording_policy(Response&, const Request& request);
+  void prioritize_recording(Response&, const Request& request);
+  void get_recorders(Response& response, const Request&);
+  void write_recorder_stats(Response& response, const Webrecorder& webrecorder);
+  void enforce_recorder_limits(Webrecorder& webrecorder);
+  size_t count_running_recordings() const;
+  void start_queued_recordings();
+  void start_webrecorder(int id, const std::vector<std::string>& arguments,
+    const std::string& working_directory);
+  void fill_warm_pool();
+  void stop_all_recordings();
   void set_library_root(Response& response, const Request& request);
   void get_library_listing(Response& response, const Request& request);
+  void invalidate_library_listing();
+  void watch_library();
+  void library_changed(const LibraryWatcher::Changes& changes);
+  std::vector<LibraryFile> get_library_files();
   void browse_directories(Response& response, const Request& request);
   void set_temporary_file(std::filesystem::path& path, std::string_view content);
   void inject_script(Response&, const Request& request);
@@ -37,15 +124,56 @@ private:
   void get_file_size(Response& response, const Request& request);
   void get_file_listing(Response& response, const Request& request);
   BackgroundWorker& background_worker();
-  Database& database();
+  std::shared_ptr<Database> database();
+  std::shared_ptr<Database> index_database();
+  void reset_database();
+  void queue_index_update(std::filesystem::path filename, bool reindex);
+  void set_indexing_policy(Response&, const Request& request);
   void update_search_index(Response&, const Request& request);
+  void optimize_search_index(Response&, const Request&);
+  void vacuum_search_index(Response&, const Request&);
+  void get_search_index_metrics(Response& response, const Request&);
+  SearchSession& search_session(const Request& request);
   void execute_search(Response& response, const Request& request);
 
   const Settings& m_settings;
-  std::unique_ptr<Database> m_database;
+  std::shared_ptr<Database> m_database;
   std::filesystem::path m_inject_script_file;
   std::filesystem::path m_block_hosts_file;
   std::filesystem::path m_library_root;
-  std::map<int, Webrecorder> m_webrecorders;
+  std::map<int, std::unique_ptr<Webrecorder>> m_webrecorders;
+  std::deque<QueuedRecording> m_queued_recordings;
+  size_t m_max_recordings;
+  RecorderLimits m_recorder_limits{ };
+  bool m_event_channel{ };
+  bool m_blob_store{ };
+  // archives of the recordings using the blob store
+  std::map<int, std::filesystem::path> m_blob_store_recordings;
+  // pre-started webrecorders waiting for their arguments
+  std::vector<std::unique_ptr<Webrecorder>> m_warm_recorders;
+  size_t m_warm_recorder_count{ };
+  bool m_warm_recorders_unsupported{ };
   std::unique_ptr<BackgroundWorker> m_background_worker;
+  // moves and deletes are executed by their own worker
+  std::unique_ptr<BackgroundWorker> m_file_worker;
+  std::mutex m_file_jobs_mutex;
+  std::map<int, std::shared_ptr<FileJob>> m_file_jobs;
+  int m_next_file_job_id{ 1 };
+  // trash is collected by the file worker while it is idle
+  TrashPolicy m_trash_policy{ };
+  FileOperationProgress m_trash_collection_progress;
+  // sorted by deletion time, only accessed by the file worker
+  std::vector<TrashEntry> m_trash_entries;
+  std::mutex m_database_mutex;
+  std::unique_ptr<LibraryWatcher> m_library_watcher;
+
+  // state shared with the library watcher and background worker
+  std::mutex m_library_mutex;
+  std::optional<std::vector<LibraryFile>> m_library_listing;
+  uint64_t m_library_generation{ };
+  std::map<std::filesystem::path, bool> m_pending_index_updates;
+  IndexingPolicy m_indexing_policy;
+
+  std::mutex m_search_sessions_mutex;
+  std::map<std::string, SearchSession, std::less<>> m_search_sessions;
 };
@@ -0,0 +1,51 @@
+
+#include "OutputBuffer.h"
+#include <algorithm>
+#include <utility>
+
+OutputBuffer::OutputBuffer(size_t capacity, IsEssential is_essential)
+  : m_capacity(capacity),
+    m_is_essential(is_essential) {
+}
+
+void OutputBuffer::append(std::string_view data) {
+  for (;;) {
+    const auto end = data.find('\n');
+    if (end == std::string_view::npos)
+      break;
+    m_incomplete_line.append(data.substr(0, end));
+    m_size += m_incomplete_line.size();
+    m_lines.push_back(std::move(m_incomplete_line));
+    m_incomplete_line.clear();
+    data.remove_prefix(end + 1);
+  }
+
+  // do not let a single endless line grow unbounded
+  m_incomplete_line.append(data.substr(0,
+    m_capacity - std::min(m_capacity, m_incomplete_line.size())));
+
+  if (m_size > m_capacity)
+    drop_oldest();
+}
+
+void OutputBuffer::drop_oldest() {
+  auto it = m_lines.begin();
+  while (m_size > m_capacity && it != m_lines.end()) {
+    if (m_is_essential(*it)) {
+      ++it;
+      continue;
+    }
+    m_size -= it->size();
+    it = m_lines.erase(it);
+    ++m_dropped;
+  }
+}
+
+size_t OutputBuffer::consume(
+    const std::function<void(std::string_view)>& callback) {
+  for (const auto& line : m_lines)
+    callback(line);
+  m_lines.clear();
+  m_size = 0;
+  return std::exchange(m_dropped, 0);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// buffers output lines up to a capacity. When it is exceeded, the oldest
+// lines are dropped, except the essential ones which are always kept.
+class OutputBuffer {
+public:
+  using IsEssential = bool(*)(std::string_view line);
+
+  OutputBuffer(size_t capacity, IsEssential is_essential);
+
+  void append(std::string_view data);
+  bool empty() const { return m_lines.empty(); }
+
+  // passes and removes all complete lines,
+  // returns the number of lines dropped since the last call
+  size_t consume(const std::function<void(std::string_view)>& callback);
+
+private:
+  void drop_oldest();
+
+  const size_t m_capacity;
+  const IsEssential m_is_essential;
+  std::deque<std::string> m_lines;
+  std::string m_incomplete_line;
+  size_t m_size{ };
+  size_t m_dropped{ };
+};
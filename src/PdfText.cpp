@@ -0,0 +1,446 @@
+
+#include "PdfText.h"
+#include "zlib.h"
+#include <cctype>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+  const auto max_inflated_stream_size = size_t{ 16 } << 20;
+  const auto max_dictionary_size = size_t{ 4096 };
+  // tokens between two checks of the deadline
+  const auto deadline_check_interval = 1024;
+  // TJ displacements in thousandths of text space, which separate words
+  const auto word_displacement = -200.0;
+
+  // Windows-1252 characters 0x80-0x9F, which differ from Latin-1
+  const uint16_t windows_1252[32] = {
+    0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+    0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178,
+  };
+
+  bool is_whitespace(char c) {
+    return (c == ' ' || c == '\n' || c == '\r' ||
+            c == '\t' || c == '\f' || c == '\0');
+  }
+
+  bool is_delimiter(char c) {
+    return (c == '(' || c == ')' || c == '<' || c == '>' || c == '[' ||
+            c == ']' || c == '{' || c == '}' || c == '/' || c == '%');
+  }
+
+  bool is_regular(char c) {
+    return (!is_whitespace(c) && !is_delimiter(c));
+  }
+
+  bool is_number(std::string_view token) {
+    for (auto c : token)
+      if (!std::isdigit(static_cast<unsigned char>(c)) &&
+          c != '.' && c != '-' && c != '+')
+        return false;
+    return !token.empty();
+  }
+
+  int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  void append_utf8(std::string& text, uint32_t code_point) {
+    if (code_point < 0x80) {
+      text.push_back(static_cast<char>(code_point));
+    }
+    else if (code_point < 0x800) {
+      text.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      text.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else {
+      text.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      text.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      text.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  void append_windows_1252(std::string& text, std::string_view string) {
+    for (auto c : string) {
+      const auto code = static_cast<unsigned char>(c);
+      if (code >= 0x80 && code < 0xA0) {
+        if (const auto code_point = windows_1252[code - 0x80])
+          append_utf8(text, code_point);
+      }
+      else if (code >= 0x20) {
+        append_utf8(text, code);
+      }
+    }
+  }
+
+  // text strings are either UTF-16BE with byte order mark or PDFDocEncoding
+  std::string decode_text_string(std::string_view string) {
+    auto text = std::string();
+    if (string.size() >= 2 &&
+        static_cast<unsigned char>(string[0]) == 0xFE &&
+        static_cast<unsigned char>(string[1]) == 0xFF) {
+      for (auto i = size_t{ 2 }; i + 1 < string.size(); i += 2) {
+        const auto code_point = static_cast<uint32_t>(
+          (static_cast<unsigned char>(string[i]) << 8) |
+           static_cast<unsigned char>(string[i + 1]));
+        if (code_point >= 0x20 && (code_point < 0xD800 || code_point > 0xDFFF))
+          append_utf8(text, code_point);
+      }
+      return text;
+    }
+    append_windows_1252(text, string);
+    return text;
+  }
+
+  // strings of fonts with multi byte encodings can not be decoded
+  // without the font's character map, they are omitted
+  void append_shown_string(std::string& text, std::string_view string) {
+    auto control_characters = size_t{ };
+    for (auto c : string)
+      if (static_cast<unsigned char>(c) < 0x20)
+        ++control_characters;
+    if (control_characters * 4 > string.size())
+      return;
+    append_windows_1252(text, string);
+  }
+
+  // position is after the opening parenthesis, returns position after closing one
+  size_t read_literal_string(std::string_view data, size_t pos, std::string& string) {
+    auto depth = 1;
+    while (pos < data.size()) {
+      const auto c = data[pos++];
+      if (c == '\\' && pos < data.size()) {
+        const auto escaped = data[pos++];
+        switch (escaped) {
+          case 'n': string.push_back('\n'); break;
+          case 'r': string.push_back('\r'); break;
+          case 't': string.push_back('\t'); break;
+          case 'b': string.push_back('\b'); break;
+          case 'f': string.push_back('\f'); break;
+          case '\n': break;
+          case '\r':
+            if (pos < data.size() && data[pos] == '\n')
+              ++pos;
+            break;
+          default:
+            if (escaped >= '0' && escaped <= '7') {
+              auto value = escaped - '0';
+              for (auto i = 0; i < 2 && pos < data.size() &&
+                   data[pos] >= '0' && data[pos] <= '7'; ++i)
+                value = value * 8 + (data[pos++] - '0');
+              string.push_back(static_cast<char>(value));
+            }
+            else {
+              string.push_back(escaped);
+            }
+            break;
+        }
+      }
+      else if (c == '(') {
+        ++depth;
+        string.push_back(c);
+      }
+      else if (c == ')') {
+        if (--depth == 0)
+          break;
+        string.push_back(c);
+      }
+      else {
+        string.push_back(c);
+      }
+    }
+    return pos;
+  }
+
+  // position is after the opening bracket, returns position after closing one
+  size_t read_hex_string(std::string_view data, size_t pos, std::string& string) {
+    auto high = -1;
+    for (; pos < data.size(); ++pos) {
+      const auto c = data[pos];
+      if (c == '>') {
+        ++pos;
+        break;
+      }
+      const auto value = hex_value(c);
+      if (value < 0)
+        continue;
+      if (high < 0) {
+        high = value;
+      }
+      else {
+        string.push_back(static_cast<char>(high * 16 + value));
+        high = -1;
+      }
+    }
+    if (high >= 0)
+      string.push_back(static_cast<char>(high * 16));
+    return pos;
+  }
+
+  std::optional<std::string> inflate_stream(std::string_view data) {
+    auto stream = z_stream{ };
+    if (inflateInit(&stream) != Z_OK)
+      return std::nullopt;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+
+    const auto chunk_size = size_t{ 64 } << 10;
+    auto inflated = std::string();
+    auto result = Z_OK;
+    while (result == Z_OK && inflated.size() < max_inflated_stream_size) {
+      const auto size = inflated.size();
+      inflated.resize(size + chunk_size);
+      stream.next_out = reinterpret_cast<Bytef*>(inflated.data() + size);
+      stream.avail_out = static_cast<uInt>(chunk_size);
+      result = inflate(&stream, Z_NO_FLUSH);
+      inflated.resize(size + chunk_size - stream.avail_out);
+    }
+    inflateEnd(&stream);
+
+    // keep what could be inflated of a damaged stream
+    if (result != Z_STREAM_END && inflated.empty())
+      return std::nullopt;
+    return inflated;
+  }
+
+  // returns the position after a key of a dictionary and following whitespace
+  size_t find_value(std::string_view dictionary, std::string_view key,
+      size_t start = 0) {
+    for (auto pos = dictionary.find(key, start); pos != std::string_view::npos;
+         pos = dictionary.find(key, pos + 1)) {
+      auto end = pos + key.size();
+      if (end < dictionary.size() && is_regular(dictionary[end]))
+        continue;
+      while (end < dictionary.size() && is_whitespace(dictionary[end]))
+        ++end;
+      return end;
+    }
+    return std::string_view::npos;
+  }
+
+  std::string_view read_name(std::string_view data, size_t pos) {
+    if (pos >= data.size() || data[pos] != '/')
+      return { };
+    const auto begin = ++pos;
+    while (pos < data.size() && is_regular(data[pos]))
+      ++pos;
+    return data.substr(begin, pos - begin);
+  }
+
+  std::string_view get_name_value(std::string_view dictionary, std::string_view key) {
+    return read_name(dictionary, find_value(dictionary, key));
+  }
+
+  // only unfiltered and FlateDecode streams are supported
+  bool is_flate_or_unfiltered(std::string_view dictionary) {
+    auto pos = find_value(dictionary, "/Filter");
+    if (pos == std::string_view::npos)
+      return true;
+    if (pos < dictionary.size() && dictionary[pos] == '[') {
+      ++pos;
+      while (pos < dictionary.size() && is_whitespace(dictionary[pos]))
+        ++pos;
+      const auto name = read_name(dictionary, pos);
+      pos += name.size() + 1;
+      while (pos < dictionary.size() && is_whitespace(dictionary[pos]))
+        ++pos;
+      return (name == "FlateDecode" &&
+              pos < dictionary.size() && dictionary[pos] == ']');
+    }
+    return (read_name(dictionary, pos) == "FlateDecode");
+  }
+
+  // the document title is a /Title entry, which is not part of an outline item
+  std::optional<std::string> find_title(std::string_view data) {
+    for (auto pos = find_value(data, "/Title"); pos != std::string_view::npos;
+         pos = find_value(data, "/Title", pos)) {
+      const auto begin = data.rfind("<<", pos);
+      const auto end = data.find(">>", pos);
+      if (begin != std::string_view::npos && end != std::string_view::npos &&
+          find_value(data.substr(begin, end - begin), "/Parent") !=
+            std::string_view::npos)
+        continue;
+
+      auto string = std::string();
+      if (pos < data.size() && data[pos] == '(')
+        read_literal_string(data, pos + 1, string);
+      else if (data.substr(pos, 1) == "<" && data.substr(pos, 2) != "<<")
+        read_hex_string(data, pos + 1, string);
+      auto title = decode_text_string(string);
+      if (!title.empty())
+        return title;
+    }
+    return std::nullopt;
+  }
+
+  // content streams have no type or are form XObjects or tiling patterns.
+  // Images, fonts, ICC profiles, functions, shadings and metadata are not
+  bool is_content_stream(std::string_view dictionary) {
+    const auto type = get_name_value(dictionary, "/Type");
+    const auto subtype = get_name_value(dictionary, "/Subtype");
+    if (!type.empty() && type != "XObject" && type != "Pattern")
+      return false;
+    if (!subtype.empty() && subtype != "Form")
+      return false;
+    for (const auto key : { "/N", "/Length1", "/Length2", "/Length3",
+                            "/FunctionType", "/ShadingType" })
+      if (find_value(dictionary, key) != std::string_view::npos)
+        return false;
+    return true;
+  }
+
+  // collects the strings of the text showing operators,
+  // returns what was collected until the deadline was reached
+  std::string get_content_stream_text(std::string_view content,
+      std::chrono::steady_clock::time_point deadline) {
+    auto text = std::string();
+    auto operands = std::vector<std::string>();
+    auto in_array = false;
+    const auto separate = [&]() {
+      if (!text.empty() && text.back() != ' ')
+        text.push_back(' ');
+    };
+
+    auto tokens = 0;
+    for (auto pos = size_t{ }; pos < content.size(); ) {
+      if (++tokens % deadline_check_interval == 0 &&
+          std::chrono::steady_clock::now() > deadline)
+        break;
+
+      const auto c = content[pos];
+      if (is_whitespace(c) || c == ')' || c == '>' || c == '{' || c == '}') {
+        ++pos;
+      }
+      else if (c == '%') {
+        pos = content.find_first_of("\r\n", pos);
+      }
+      else if (c == '(') {
+        pos = read_literal_string(content, pos + 1, operands.emplace_back());
+      }
+      else if (c == '<') {
+        if (content.substr(pos, 2) == "<<")
+          pos += 2;
+        else
+          pos = read_hex_string(content, pos + 1, operands.emplace_back());
+      }
+      else if (c == '[' || c == ']') {
+        in_array = (c == '[');
+        ++pos;
+      }
+      else if (c == '/') {
+        pos += read_name(content, pos).size() + 1;
+      }
+      else {
+        const auto begin = pos;
+        while (pos < content.size() && is_regular(content[pos]))
+          ++pos;
+        const auto token = content.substr(begin, pos - begin);
+        if (token.empty()) {
+          // unexpected delimiter
+          ++pos;
+          continue;
+        }
+        if (is_number(token)) {
+          if (in_array && std::strtod(std::string(token).c_str(),
+                nullptr) <= word_displacement)
+            operands.emplace_back(" ");
+          continue;
+        }
+
+        if (token == "Tj" || token == "TJ") {
+          for (const auto& operand : operands)
+            append_shown_string(text, operand);
+        }
+        else if (token == "'" || token == "\"") {
+          separate();
+          if (!operands.empty())
+            append_shown_string(text, operands.back());
+        }
+        else if (token == "Td" || token == "TD" || token == "T*" ||
+                 token == "Tm" || token == "ET") {
+          separate();
+        }
+        else if (token == "BI") {
+          // skip inline image data
+          pos = content.find("EI", pos);
+          if (pos != std::string_view::npos)
+            pos += 2;
+        }
+        operands.clear();
+        in_array = false;
+      }
+    }
+    return text;
+  }
+} // namespace
+
+void for_each_pdf_text(std::string_view pdf,
+    std::chrono::steady_clock::time_point deadline,
+    const std::function<void(std::string_view text)>& text_callback,
+    const std::function<void(std::string_view title)>& title_callback) {
+
+  if (pdf.substr(0, 1024).find("%PDF-") == std::string_view::npos)
+    return;
+
+  auto title = find_title(pdf);
+  const auto stream_keyword = std::string_view("stream");
+  for (auto pos = pdf.find(stream_keyword); pos != std::string_view::npos;
+       pos = pdf.find(stream_keyword, pos)) {
+    if (std::chrono::steady_clock::now() > deadline)
+      break;
+
+    // keyword is followed by an end of line and preceded by the dictionary
+    auto begin = pos + stream_keyword.size();
+    if (begin < pdf.size() && pdf[begin] == '\r')
+      ++begin;
+    if (begin >= pdf.size() || pdf[begin] != '\n' ||
+        pdf.substr(pos >= 3 ? pos - 3 : 0, 3) == "end") {
+      pos = begin;
+      continue;
+    }
+    ++begin;
+    const auto end = pdf.find("endstream", begin);
+    if (end == std::string_view::npos)
+      break;
+
+    const auto search_begin = (pos > max_dictionary_size ? pos - max_dictionary_size : 0);
+    const auto object = pdf.substr(search_begin, pos - search_begin).rfind("obj");
+    const auto dictionary = (object == std::string_view::npos ?
+      std::string_view() : pdf.substr(search_begin + object, pos - search_begin - object));
+    const auto data = pdf.substr(begin, end - begin);
+    pos = end + 9;
+
+    // skip images, fonts, metadata and cross reference streams
+    const auto type = get_name_value(dictionary, "/Type");
+    if ((type != "ObjStm" && !is_content_stream(dictionary)) ||
+        !is_flate_or_unfiltered(dictionary))
+      continue;
+
+    const auto compressed = (find_value(dictionary, "/Filter") != std::string_view::npos);
+    const auto inflated = (compressed ? inflate_stream(data) : std::nullopt);
+    if (compressed && !inflated)
+      continue;
+    const auto content = (inflated ? std::string_view(*inflated) : data);
+
+    // document information can be part of a compressed object stream
+    if (type == "ObjStm") {
+      if (!title)
+        title = find_title(content);
+      continue;
+    }
+
+    const auto text = get_content_stream_text(content, deadline);
+    if (!text.empty())
+      text_callback(text);
+  }
+
+  if (title)
+    title_callback(*title);
+}
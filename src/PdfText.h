@@ -0,0 +1,14 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string_view>
+
+// extracts the text shown by the content streams of a PDF document one
+// stream at a time. Only uncompressed and FlateDecode streams are read and
+// font encodings are ignored, so text of CID fonts can not be extracted.
+// Stops when the deadline was reached.
+void for_each_pdf_text(std::string_view pdf,
+  std::chrono::steady_clock::time_point deadline,
+  const std::function<void(std::string_view text)>& text_callback,
+  const std::function<void(std::string_view title)>& title_callback);
@@ -0,0 +1,263 @@
+
+#include "ProcessReactor.h"
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct ProcessReactor::Process {
+  int pid;
+  int output_fd;
+  int event_fd;
+  int pid_fd;
+  bool exited;
+  OutputCallback output_callback;
+  OutputCallback event_callback;
+  FinishedCallback finished_callback;
+};
+
+namespace {
+  const auto max_events = 32;
+  const auto read_buffer_size = 64 * 1024;
+
+  int open_pid_fd([[maybe_unused]] int pid) {
+#if defined(SYS_pidfd_open)
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    return -1;
+#endif
+  }
+
+  void close_inherited_fds(int first_fd) {
+#if defined(SYS_close_range)
+    if (syscall(SYS_close_range, first_fd, ~0u, 0) == 0)
+      return;
+#endif
+    const auto fd_max = static_cast<int>(sysconf(_SC_OPEN_MAX));
+    for (auto fd = first_fd; fd < fd_max; ++fd)
+      close(fd);
+  }
+
+  void close_fd(int& fd) {
+    if (fd >= 0)
+      close(std::exchange(fd, -1));
+  }
+
+  void close_pipe(int (&fds)[2]) {
+    close_fd(fds[0]);
+    close_fd(fds[1]);
+  }
+
+  int spawn_process(const std::vector<std::string>& arguments,
+      const std::string& working_directory, int input_fd, int output_fd,
+      int event_fd) {
+    if (arguments.empty())
+      return -1;
+
+    // only async-signal-safe functions may be called in the child
+    auto argv = std::vector<char*>();
+    for (const auto& argument : arguments)
+      argv.push_back(const_cast<char*>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    const auto pid = fork();
+    if (pid != 0) {
+      // also in parent, so the process group exists when signaling it
+      if (pid > 0)
+        setpgid(pid, pid);
+      return pid;
+    }
+
+    if (input_fd >= 0)
+      dup2(input_fd, STDIN_FILENO);
+    dup2(output_fd, STDOUT_FILENO);
+    auto first_inherited_fd = STDERR_FILENO + 1;
+    if (event_fd >= 0) {
+      const auto event_channel_fd = ProcessReactor::event_channel_fd;
+      if (event_fd != event_channel_fd)
+        dup2(event_fd, event_channel_fd);
+      else
+        fcntl(event_channel_fd, F_SETFD, 0);
+      first_inherited_fd = event_channel_fd + 1;
+    }
+    close_inherited_fds(first_inherited_fd);
+    setpgid(0, 0);
+    if (!working_directory.empty() && chdir(working_directory.c_str()) != 0)
+      _exit(EXIT_FAILURE);
+    execv(argv[0], argv.data());
+    _exit(EXIT_FAILURE);
+  }
+} // namespace
+
+ProcessReactor::ProcessReactor()
+  : m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+    m_wake_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  if (m_epoll_fd < 0 || m_wake_fd < 0)
+    throw std::runtime_error("creating process reactor failed");
+
+  auto event = epoll_event{ };
+  event.events = EPOLLIN;
+  event.data.fd = m_wake_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event);
+  m_thread = std::thread(&ProcessReactor::thread_func, this);
+}
+
+ProcessReactor::~ProcessReactor() {
+  const auto value = uint64_t{ 1 };
+  [[maybe_unused]] const auto result = write(m_wake_fd, &value, sizeof(value));
+  m_thread.join();
+
+  for (const auto& [fd, process] : m_processes)
+    close(fd);
+  close(m_wake_fd);
+  close(m_epoll_fd);
+}
+
+int ProcessReactor::start(const std::vector<std::string>& arguments,
+    const std::string& working_directory,
+    OutputCallback output_callback,
+    FinishedCallback finished_callback,
+    int* input_fd,
+    OutputCallback event_callback) {
+  int input_fds[2]{ -1, -1 };
+  int output_fds[2]{ -1, -1 };
+  int event_fds[2]{ -1, -1 };
+  if ((input_fd && socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, input_fds) != 0) ||
+      pipe2(output_fds, O_CLOEXEC) != 0 ||
+      (event_callback && pipe2(event_fds, O_CLOEXEC) != 0)) {
+    close_pipe(input_fds);
+    close_pipe(output_fds);
+    close_pipe(event_fds);
+    return -1;
+  }
+
+  const auto pid = spawn_process(arguments, working_directory,
+    input_fds[0], output_fds[1], event_fds[1]);
+  close_fd(input_fds[0]);
+  close_fd(output_fds[1]);
+  close_fd(event_fds[1]);
+  if (pid < 0) {
+    close_pipe(input_fds);
+    close_pipe(output_fds);
+    close_pipe(event_fds);
+    return -1;
+  }
+  if (input_fd)
+    *input_fd = input_fds[1];
+  for (auto fd : { output_fds[0], event_fds[0] })
+    if (fd >= 0)
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  auto process = std::make_shared<Process>(Process{
+    pid, output_fds[0], event_fds[0], open_pid_fd(pid), false,
+    std::move(output_callback), std::move(event_callback),
+    std::move(finished_callback)
+  });
+  auto lock = std::lock_guard(m_mutex);
+  watch(process->output_fd, process);
+  if (process->event_fd >= 0)
+    watch(process->event_fd, process);
+  if (process->pid_fd >= 0)
+    watch(process->pid_fd, process);
+  return pid;
+}
+
+void ProcessReactor::thread_func() noexcept {
+  epoll_event events[max_events];
+  for (;;) {
+    const auto count = epoll_wait(m_epoll_fd, events, max_events, -1);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (auto i = 0; i < count; ++i) {
+      if (events[i].data.fd == m_wake_fd)
+        return;
+      try {
+        handle_event(events[i].data.fd);
+      }
+      catch (...) {
+      }
+    }
+  }
+}
+
+void ProcessReactor::handle_event(int fd) {
+  auto lock = std::lock_guard(m_mutex);
+  const auto it = m_processes.find(fd);
+  if (it == m_processes.end())
+    return;
+  const auto process = it->second;
+
+  if (fd == process->output_fd) {
+    if (!read_output(fd, process->output_callback)) {
+      process->output_fd = -1;
+      if (process->pid_fd < 0) {
+        // without pidfd, wait for the process which is about to exit
+        while (waitpid(process->pid, nullptr, 0) < 0 && errno == EINTR) { }
+        process->exited = true;
+      }
+    }
+  }
+  else if (fd == process->event_fd) {
+    if (!read_output(fd, process->event_callback))
+      process->event_fd = -1;
+  }
+  else if (fd == process->pid_fd) {
+    if (waitpid(process->pid, nullptr, WNOHANG) != 0) {
+      unwatch(fd);
+      process->pid_fd = -1;
+      process->exited = true;
+    }
+  }
+
+  // report finished after all output was passed
+  if (process->exited && process->output_fd < 0 && process->event_fd < 0)
+    process->finished_callback();
+}
+
+// returns false and stops watching on end of output
+bool ProcessReactor::read_output(int fd, const OutputCallback& callback) {
+  char buffer[read_buffer_size];
+  for (;;) {
+    const auto size = read(fd, buffer, sizeof(buffer));
+    if (size > 0) {
+      callback(buffer, static_cast<size_t>(size));
+      continue;
+    }
+    if (size < 0 && errno == EINTR)
+      continue;
+    if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return true;
+
+    unwatch(fd);
+    return false;
+  }
+}
+
+void ProcessReactor::watch(int fd, const std::shared_ptr<Process>& process) {
+  auto event = epoll_event{ };
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+  m_processes[fd] = process;
+}
+
+void ProcessReactor::unwatch(int fd) {
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  m_processes.erase(fd);
+}
+
+#endif // __linux__
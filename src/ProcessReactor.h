@@ -0,0 +1,58 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// starts child processes and monitors their output and termination
+// for all of them with a single epoll thread
+class ProcessReactor {
+public:
+  using OutputCallback = std::function<void(const char* data, size_t size)>;
+  using FinishedCallback = std::function<void()>;
+
+  ProcessReactor();
+  ProcessReactor(const ProcessReactor&) = delete;
+  ProcessReactor& operator=(const ProcessReactor&) = delete;
+  ~ProcessReactor();
+
+  // file descriptor of the optional event channel within the process
+  static constexpr int event_channel_fd = 3;
+
+  // output callback is called with data read from the process' stdout,
+  // finished callback is called last, after the process exited.
+  // When input_fd is passed, it receives a socket connected to the process'
+  // stdin, which the caller has to close (write with MSG_NOSIGNAL to not
+  // receive SIGPIPE). When an event callback is passed, it is called with
+  // data the process writes to the event channel.
+  // Returns the process id or -1 on failure.
+  int start(const std::vector<std::string>& arguments,
+            const std::string& working_directory,
+            OutputCallback output_callback,
+            FinishedCallback finished_callback,
+            int* input_fd = nullptr,
+            OutputCallback event_callback = nullptr);
+
+private:
+  struct Process;
+
+  void thread_func() noexcept;
+  void handle_event(int fd);
+  bool read_output(int fd, const OutputCallback& callback);
+  void watch(int fd, const std::shared_ptr<Process>& process);
+  void unwatch(int fd);
+
+  int m_epoll_fd{ -1 };
+  int m_wake_fd{ -1 };
+  std::mutex m_mutex;
+  std::map<int, std::shared_ptr<Process>> m_processes;
+  std::thread m_thread;
+};
+
+#endif // __linux__
@@ -0,0 +1,81 @@
+
+#include "ProcessStats.h"
+
+#if defined(__linux__)
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+  std::string read_proc_file(int pid, const char* name) {
+    auto file = std::ifstream("/proc/" + std::to_string(pid) + "/" + name);
+    auto ss = std::stringstream();
+    ss << file.rdbuf();
+    return ss.str();
+  }
+
+  std::optional<std::chrono::milliseconds> read_cpu_time(int pid) {
+    // process name in parentheses can contain spaces
+    const auto stat = read_proc_file(pid, "stat");
+    const auto name_end = stat.rfind(')');
+    if (name_end == std::string::npos)
+      return std::nullopt;
+
+    // skip state (3rd field) up to cmajflt (13th field), followed by utime and stime
+    auto ss = std::istringstream(stat.substr(name_end + 1));
+    auto field = std::string();
+    for (auto i = 3; i <= 13; ++i)
+      ss >> field;
+    auto user_ticks = uint64_t{ }, system_ticks = uint64_t{ };
+    if (!(ss >> user_ticks >> system_ticks))
+      return std::nullopt;
+
+    const auto ticks_per_second = static_cast<uint64_t>(sysconf(_SC_CLK_TCK));
+    return std::chrono::milliseconds(
+      (user_ticks + system_ticks) * 1000 / ticks_per_second);
+  }
+
+  std::optional<uint64_t> read_memory(int pid) {
+    auto ss = std::istringstream(read_proc_file(pid, "statm"));
+    auto size = uint64_t{ }, resident = uint64_t{ };
+    if (!(ss >> size >> resident))
+      return std::nullopt;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  }
+
+  void read_io(int pid, uint64_t& read_bytes, uint64_t& written_bytes) {
+    auto ss = std::istringstream(read_proc_file(pid, "io"));
+    auto key = std::string();
+    auto value = uint64_t{ };
+    while (ss >> key >> value) {
+      if (key == "rchar:")
+        read_bytes = value;
+      else if (key == "wchar:")
+        written_bytes = value;
+    }
+  }
+} // namespace
+
+std::optional<ProcessStats> sample_process_stats(int pid) {
+  if (pid <= 0)
+    return std::nullopt;
+  const auto cpu_time = read_cpu_time(pid);
+  const auto memory = read_memory(pid);
+  if (!cpu_time || !memory)
+    return std::nullopt;
+
+  auto stats = ProcessStats{ *cpu_time, *memory, 0, 0 };
+  // not readable for processes of other users
+  read_io(pid, stats.read_bytes, stats.written_bytes);
+  return stats;
+}
+
+#else // !__linux__
+
+std::optional<ProcessStats> sample_process_stats(int) {
+  return std::nullopt;
+}
+
+#endif // !__linux__
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+struct ProcessStats {
+  std::chrono::milliseconds cpu_time;
+  // resident set size
+  uint64_t memory;
+  // bytes passed to read and write calls, including pipes
+  uint64_t read_bytes;
+  uint64_t written_bytes;
+};
+
+// samples the resource usage of a running process,
+// only implemented on Linux, where it is read from /proc
+std::optional<ProcessStats> sample_process_stats(int pid);
@@ -0,0 +1,98 @@
+
+#include "SearchCache.h"
+
+namespace {
+  struct QueryToken {
+    std::string_view string;
+    bool prefix;
+  };
+
+  bool is_bareword_char(char c) {
+    const auto u = static_cast<unsigned char>(c);
+    return ((u >= '0' && u <= '9') ||
+            (u >= 'a' && u <= 'z') ||
+            (u >= 'A' && u <= 'Z') ||
+            u >= 0x80);
+  }
+
+  // only a sequence of barewords, each optionally followed by *, is
+  // supported. returns false when the query contains any other syntax
+  bool tokenize_query(std::string_view query, std::vector<QueryToken>& tokens) {
+    for (auto i = size_t{ }; i < query.size(); ) {
+      const auto c = query[i];
+      if (c == ' ') {
+        ++i;
+      }
+      else if (c == '*') {
+        if (tokens.empty() || tokens.back().prefix)
+          return false;
+        tokens.back().prefix = true;
+        ++i;
+      }
+      else if (is_bareword_char(c)) {
+        const auto begin = i;
+        while (i < query.size() && is_bareword_char(query[i]))
+          ++i;
+        const auto string = query.substr(begin, i - begin);
+        if (string == "AND" || string == "OR" || string == "NOT" || string == "NEAR")
+          return false;
+        tokens.push_back({ string, false });
+      }
+      else {
+        return false;
+      }
+    }
+    return !tokens.empty();
+  }
+
+  // every token of the previous query must be a prefix token,
+  // which is a prefix of the token at the same position
+  bool is_refinement(std::string_view previous_query, std::string_view query) {
+    auto previous = std::vector<QueryToken>();
+    auto current = std::vector<QueryToken>();
+    if (!tokenize_query(previous_query, previous) ||
+        !tokenize_query(query, current) ||
+        previous.size() > current.size())
+      return false;
+
+    for (auto i = size_t{ }; i < previous.size(); ++i)
+      if (!previous[i].prefix ||
+          current[i].string.substr(0, previous[i].string.size()) !=
+            previous[i].string)
+        return false;
+    return true;
+  }
+} // namespace
+
+SearchCache::SearchCache(size_t capacity)
+  : m_capacity(capacity) {
+}
+
+const CachedSearch* SearchCache::find(std::string_view options,
+    std::string_view query) {
+  for (auto it = m_searches.begin(); it != m_searches.end(); ++it)
+    if (it->options == options && it->query == query) {
+      m_searches.splice(m_searches.begin(), m_searches, it);
+      return &m_searches.front();
+    }
+  return nullptr;
+}
+
+const CachedSearch* SearchCache::find_refined(std::string_view options,
+    std::string_view query) {
+  for (const auto& search : m_searches)
+    if (search.options == options && is_refinement(search.query, query))
+      return &search;
+  return nullptr;
+}
+
+const CachedSearch& SearchCache::insert(CachedSearch search) {
+  m_searches.push_front(std::move(search));
+  if (m_searches.size() > m_capacity)
+    m_searches.pop_back();
+  return m_searches.front();
+}
+
+void SearchCache::clear() {
+  m_searches.clear();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using RowIds = std::vector<int64_t>;
+
+struct CachedSearch {
+  std::string options;
+  std::string query;
+  // matches in rank order, deduplicated by url
+  RowIds matches;
+  bool complete;
+  // all matched rowids, when the result was not truncated
+  std::optional<RowIds> rowids;
+};
+
+// LRU cache of recent search results, which is able to provide the
+// results of a query, the new query is a refinement of
+// (e.g. "hamster*" is a refinement of "ham*" and "hamster*food*")
+class SearchCache {
+public:
+  explicit SearchCache(size_t capacity);
+
+  const CachedSearch* find(std::string_view options, std::string_view query);
+  const CachedSearch* find_refined(std::string_view options, std::string_view query);
+  const CachedSearch& insert(CachedSearch search);
+  void clear();
+
+private:
+  size_t m_capacity;
+  std::list<CachedSearch> m_searches;
+};
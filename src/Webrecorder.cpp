@@ -1,6 +1,15 @@
 
 #include "Webrecorder.h"
+#include "ProcessReactor.h"
 #include <cstring>
+#include <utility>
+
+#if defined(__linux__)
+# include <cerrno>
+# include <csignal>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
 
 #if defined(_WIN32)
 # define WIN32_LEAN_AND_MEAN
@@ -13,6 +22,27 @@
 using namespace std::placeholders;
 
 namespace {
+  const auto max_output_size = size_t{ 1 } << 20;
+  const auto control_mode_argument = "--control-stdin";
+  const auto control_mode_ready = std::string_view("READY");
+  const auto shutdown_timeout = std::chrono::seconds(2);
+#if defined(__linux__)
+  const auto event_channel_argument = "--event-fd";
+  const auto event_channel_supported = true;
+#else
+  const auto event_channel_supported = false;
+#endif
+
+  // lines which are never dropped when the output buffer is full
+  bool is_essential_output(std::string_view line) {
+    const auto starts_with = [&](std::string_view prefix) {
+      return (line.substr(0, prefix.size()) == prefix);
+    };
+    return (starts_with("STARTING") || starts_with("ACCEPT ") ||
+            starts_with("REDIRECT ") || starts_with("LIMIT_EXCEEDED ") ||
+            starts_with("FINISHED"));
+  }
+
 #if defined(_WIN32)
   std::wstring utf8_to_native(const std::string& str) {
     auto result = std::wstring();
@@ -36,64 +66,230 @@ namespace {
     return args;
   }
 #endif
+
+#if defined(__linux__)
+  // a single thread monitors all webrecorder processes
+  ProcessReactor& process_reactor() {
+    static auto s_reactor = ProcessReactor();
+    return s_reactor;
+  }
+#endif
 } // namespace
 
 Webrecorder::Webrecorder(
     const std::vector<std::string>& arguments,
-    const std::string& working_directory) {
+    const std::string& working_directory,
+    bool event_channel)
+  : m_event_channel(event_channel && event_channel_supported),
+    m_output(max_output_size, &is_essential_output),
+    m_events(max_output_size) {
 
-  const auto message = std::string_view("STARTING\n");
-  m_output_buffer.insert(end(m_output_buffer), message.begin(), message.end());
-
-  m_process.emplace(utf8_to_native(arguments), utf8_to_native(working_directory),
-      std::bind(&Webrecorder::handle_output, this, _1, _2));
-  if (!m_process->get_id())
-    throw std::runtime_error("starting webrecorder process failed");
-
-  m_thread = std::thread(&Webrecorder::thread_func, this);
+  m_output.append("STARTING\n");
+  start(arguments, working_directory, false);
 
   // wait for first output, so first poll receives it, to optimize latency
   auto lock = std::unique_lock(m_output_mutex);
   m_output_signal.wait_for(lock,
     std::chrono::milliseconds(500),
-    [&]() { return !m_output_buffer.empty(); });
+    [&]() { return !m_output.empty() || !m_events.empty(); });
+}
+
+Webrecorder::Webrecorder(const std::string& executable, bool event_channel)
+  : m_event_channel(event_channel && event_channel_supported),
+    m_output(max_output_size, &is_essential_output),
+    m_events(max_output_size) {
+  start({ executable, control_mode_argument }, "", true);
 }
 
 Webrecorder::~Webrecorder() {
+#if defined(__linux__)
+  // a pre-started webrecorder exits, when its control channel is closed
+  if (m_control_fd >= 0)
+    close(std::exchange(m_control_fd, -1));
+#endif
   stop();
+  if (!wait_until_finished(std::chrono::steady_clock::now() + shutdown_timeout))
+    kill();
+#if defined(__linux__)
+  // reactor callbacks reference this instance until it finished
+  auto lock = std::unique_lock(m_output_mutex);
+  m_output_signal.wait(lock, [&]() { return m_finished; });
+#else
   m_thread.join();
+#endif
+}
+
+void Webrecorder::start(const std::vector<std::string>& arguments,
+    const std::string& working_directory, bool control_mode) {
+  m_start_time = std::chrono::steady_clock::now();
+#if defined(__linux__)
+  auto event_callback = ProcessReactor::OutputCallback();
+  if (m_event_channel)
+    event_callback = std::bind(&Webrecorder::handle_events, this, _1, _2);
+
+  // in control mode the arguments are passed by assign
+  auto all_arguments = arguments;
+  if (!control_mode)
+    for (auto& argument : event_channel_arguments())
+      all_arguments.push_back(std::move(argument));
+
+  m_pid = process_reactor().start(all_arguments, working_directory,
+    std::bind(&Webrecorder::handle_output, this, _1, _2),
+    std::bind(&Webrecorder::handle_finished, this),
+    control_mode ? &m_control_fd : nullptr,
+    std::move(event_callback));
+  if (m_pid <= 0)
+    throw std::runtime_error("starting webrecorder process failed");
+#else
+  m_process.emplace(utf8_to_native(arguments), utf8_to_native(working_directory),
+      std::bind(&Webrecorder::handle_output, this, _1, _2), nullptr, control_mode);
+  if (!m_process->get_id())
+    throw std::runtime_error("starting webrecorder process failed");
+
+  m_thread = std::thread(&Webrecorder::thread_func, this);
+#endif
+}
+
+bool Webrecorder::assign(const std::vector<std::string>& arguments,
+    const std::string& working_directory) {
+  auto lock = std::lock_guard(m_output_mutex);
+  if (m_finished || m_assigned)
+    return false;
+
+  // handshake, discard output until it is ready
+  m_output.consume([&](std::string_view line) {
+    if (line == control_mode_ready)
+      m_ready = true;
+  });
+  if (!m_ready)
+    return false;
+
+  // one line per value, terminated by an empty line
+  auto message = working_directory + '\n';
+  for (auto i = size_t{ 1 }; i < arguments.size(); ++i) {
+    if (arguments[i].empty() || arguments[i].find('\n') != std::string::npos)
+      return false;
+    message += arguments[i] + '\n';
+  }
+  for (const auto& argument : event_channel_arguments())
+    message += argument + '\n';
+  message += '\n';
+  if (!write_control(message))
+    return false;
+
+  m_assigned = true;
+  m_start_time = std::chrono::steady_clock::now();
+  m_output.append("STARTING\n");
+  return true;
+}
+
+bool Webrecorder::write_control(std::string_view data) {
+#if defined(__linux__)
+  while (!data.empty()) {
+    const auto size = send(m_control_fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (size < 0 && errno == EINTR)
+      continue;
+    if (size <= 0)
+      return false;
+    data.remove_prefix(static_cast<size_t>(size));
+  }
+  return true;
+#else
+  return m_process->write(data.data(), data.size());
+#endif
+}
+
+std::vector<std::string> Webrecorder::event_channel_arguments() const {
+  if (!m_event_channel)
+    return { };
+#if defined(__linux__)
+  return { event_channel_argument,
+           std::to_string(ProcessReactor::event_channel_fd) };
+#else
+  return { };
+#endif
+}
+
+int Webrecorder::process_id() const {
+#if defined(__linux__)
+  return m_pid;
+#else
+  return static_cast<int>(m_process->get_id());
+#endif
+}
+
+void Webrecorder::append_event(std::string_view event) {
+  auto lock = std::lock_guard(m_output_mutex);
+  m_output.append(std::string(event) + '\n');
+}
+
+bool Webrecorder::update_stats(std::chrono::steady_clock::duration interval) {
+  const auto now = std::chrono::steady_clock::now();
+  if (m_stats && now - m_stats_time < interval)
+    return false;
+  // do not sample a process id, which might already be reused
+  if (finished())
+    return false;
+  m_stats_time = now;
+  m_stats = sample_process_stats(process_id());
+  return m_stats.has_value();
+}
+
+std::chrono::steady_clock::duration Webrecorder::running_time() const {
+  return std::chrono::steady_clock::now() - m_start_time;
 }
 
 void Webrecorder::stop() {
+  auto lock = std::unique_lock(m_output_mutex);
+  m_stopping = true;
 #if defined(_WIN32)
+  lock.unlock();
   // almost too easy
   TinyProcessLib::Process ctrl_c_process(
     utf8_to_native("ctrl_c " + std::to_string(m_process->get_id())));
   if (ctrl_c_process.get_exit_status())
     m_process->kill();
+#elif defined(__linux__)
+  if (!m_finished)
+    ::kill(-m_pid, SIGINT);
 #else
+  lock.unlock();
   m_process->kill();
 #endif
 }
 
-void Webrecorder::for_each_output_line(
+void Webrecorder::kill() {
+#if defined(__linux__)
+  auto lock = std::lock_guard(m_output_mutex);
+  if (!m_finished)
+    ::kill(-m_pid, SIGKILL);
+#else
+  m_process->kill(true);
+#endif
+}
+
+bool Webrecorder::wait_until_finished(
+    std::chrono::steady_clock::time_point deadline) {
+  auto lock = std::unique_lock(m_output_mutex);
+  return m_output_signal.wait_until(lock, deadline, [&]() { return m_finished; });
+}
+
+size_t Webrecorder::for_each_output_line(
     const std::function<void(std::string_view)>& callback) {
 
   auto lock = std::lock_guard(m_output_mutex);
-  const auto begin = m_output_buffer.begin();
-  const auto end = m_output_buffer.end();
-  auto line_begin = begin;
-  for (;;) {
-    const auto it = std::find(line_begin, end, '\n');
-    if (it == end)
-      break;
-    callback({
-      &*line_begin,
-      static_cast<std::string_view::size_type>(std::distance(line_begin, it))
-    });
-    line_begin = it + 1;
-  }
-  m_output_buffer.erase(begin, line_begin);
+  return m_output.consume(callback);
+}
+
+size_t Webrecorder::for_each_event(
+    const std::function<void(const EventFrameBuffer::Event&)>& callback) {
+  auto lock = std::lock_guard(m_output_mutex);
+  return m_events.consume(callback);
+}
+
+bool Webrecorder::stopping() const {
+  auto lock = std::lock_guard(m_output_mutex);
+  return (m_stopping || m_finished);
 }
 
 bool Webrecorder::finished() const {
@@ -101,23 +297,31 @@ bool Webrecorder::finished() const {
   return m_finished;
 }
 
+#if !defined(__linux__)
 void Webrecorder::thread_func() noexcept {
   m_process->get_exit_status();
   handle_finished();
 }
+#endif
 
 void Webrecorder::handle_output(const char* data, size_t size) {
   auto lock = std::unique_lock(m_output_mutex);
-  m_output_buffer.insert(end(m_output_buffer), data, data + size);
+  m_output.append({ data, size });
   lock.unlock();
   m_output_signal.notify_one();
 }
 
-void Webrecorder::handle_finished() {
+void Webrecorder::handle_events(const char* data, size_t size) {
   auto lock = std::unique_lock(m_output_mutex);
-  const auto message = std::string_view("FINISHED\n");
-  m_output_buffer.insert(end(m_output_buffer), message.begin(), message.end());
-  m_finished = true;
+  m_events.append(data, size);
   lock.unlock();
   m_output_signal.notify_one();
 }
+
+void Webrecorder::handle_finished() {
+  auto lock = std::unique_lock(m_output_mutex);
+  m_output.append("FINISHED\n");
+  m_finished = true;
+  // notify while locked, the destructor may be waiting for it
+  m_output_signal.notify_all();
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "OutputBuffer.h"
+#include "EventFrameBuffer.h"
+#include "ProcessStats.h"
 #include "libs/TinyProcessLib/process.hpp"
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
@@ -9,23 +13,72 @@
 
 class Webrecorder {
 public:
+  // with an event channel, the webrecorder writes binary event frames to a
+  // dedicated pipe (only supported on Linux)
   Webrecorder(const std::vector<std::string>& arguments,
-              const std::string& working_directory);
+              const std::string& working_directory,
+              bool event_channel = false);
+  // starts a webrecorder in control mode, which is
+  // waiting for its arguments to be passed by assign
+  explicit Webrecorder(const std::string& executable,
+                       bool event_channel = false);
   ~Webrecorder();
 
+  // passes the working directory and arguments (without the executable)
+  // over the control channel, fails when the handshake was not completed
+  bool assign(const std::vector<std::string>& arguments,
+              const std::string& working_directory);
+  // asks it to finish writing the archive and exit
   void stop();
+  // terminates it immediately
+  void kill();
+  // returns false when it did not finish before the deadline
+  bool wait_until_finished(std::chrono::steady_clock::time_point deadline);
+  // stop was called or it finished
+  bool stopping() const;
   bool finished() const;
-  void for_each_output_line(const std::function<void(std::string_view)>& callback);
+  // adds an event to the output, which is never dropped
+  void append_event(std::string_view event);
+  // samples the process' resource usage at most once per interval,
+  // returns whether a new sample was taken
+  bool update_stats(std::chrono::steady_clock::duration interval);
+  const std::optional<ProcessStats>& stats() const { return m_stats; }
+  std::chrono::steady_clock::duration running_time() const;
+  // returns the number of lines, which were dropped since the last call
+  size_t for_each_output_line(const std::function<void(std::string_view)>& callback);
+  // events received on the event channel
+  size_t for_each_event(
+    const std::function<void(const EventFrameBuffer::Event&)>& callback);
 
 private:
-  void thread_func() noexcept;
+  void start(const std::vector<std::string>& arguments,
+             const std::string& working_directory, bool control_mode);
+  bool write_control(std::string_view data);
+  int process_id() const;
+  std::vector<std::string> event_channel_arguments() const;
   void handle_output(const char* data, size_t size);
+  void handle_events(const char* data, size_t size);
   void handle_finished();
 
+#if defined(__linux__)
+  int m_pid{ };
+  int m_control_fd{ -1 };
+#else
+  void thread_func() noexcept;
+
   std::optional<TinyProcessLib::Process> m_process;
   std::thread m_thread;
+#endif
+  const bool m_event_channel;
   mutable std::mutex m_output_mutex;
   std::condition_variable m_output_signal;
-  std::vector<char> m_output_buffer;
+  OutputBuffer m_output;
+  EventFrameBuffer m_events;
   bool m_finished{ };
+  bool m_ready{ };
+  bool m_assigned{ };
+  bool m_stopping{ };
+  std::chrono::steady_clock::time_point m_start_time;
+  std::chrono::steady_clock::time_point m_stats_time;
+  std::optional<ProcessStats> m_stats;
 };
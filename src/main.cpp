@@ -3,6 +3,9 @@
 #include "Settings.h"
 #include "Logic.h"
 #include "common.h"
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 namespace {
   void handle_request(Logic& logic, Response& response, const Request& request) {
@@ -81,12 +84,46 @@ int run(int argc, const char* argv[]) noexcept try {
 
   auto logic = Logic(settings);
 
-  auto buffer = std::vector<char>();
+  // requests are read in a separate thread, so a newer request can
+  // supersede the one currently handled
+  auto mutex = std::mutex();
+  auto signal = std::condition_variable();
+  auto requests = std::deque<json::Document>();
+  auto read_exception = std::exception_ptr();
+  auto read_finished = false;
+  auto reader = std::thread([&]() {
+    auto buffer = std::vector<char>();
+    for (;;) {
+      auto line = read(settings.plain_stdio_interface, buffer);
+      auto lock = std::unique_lock(mutex);
+      if (line.empty())
+        break;
+      try {
+        auto request = json::parse(line);
+        logic.request_received(request);
+        requests.push_back(std::move(request));
+      }
+      catch (...) {
+        read_exception = std::current_exception();
+        break;
+      }
+      lock.unlock();
+      signal.notify_one();
+    }
+    auto lock = std::unique_lock(mutex);
+    read_finished = true;
+    signal.notify_one();
+  });
+
   for (;;) {
-    auto line = read(settings.plain_stdio_interface, buffer);
-    if (line.empty())
+    auto lock = std::unique_lock(mutex);
+    signal.wait(lock, [&]() { return read_finished || !requests.empty(); });
+    if (requests.empty())
       break;
-    auto request = json::parse(line);
+    auto request = std::move(requests.front());
+    requests.pop_front();
+    lock.unlock();
+
     try {
       write(settings.plain_stdio_interface,
         json::build_string([&](Response& response) {
@@ -100,6 +137,9 @@ int run(int argc, const char* argv[]) noexcept try {
         }));
     }
   }
+  reader.join();
+  if (read_exception)
+    std::rethrow_exception(read_exception);
   return 0;
 }
 catch (const std::exception& ex) {
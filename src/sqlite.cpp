@@ -170,13 +170,54 @@ QueryResult Statement::query() {
 
 //-------------------------------------------------------------------------
 
+FunctionContext::FunctionContext(sqlite3_context* context,
+    int argument_count, sqlite3_value** arguments)
+  : m_context(context),
+    m_argument_count(argument_count),
+    m_arguments(arguments) {
+}
+
+Type FunctionContext::argument_type(int argument) const {
+  return static_cast<Type>(sqlite3_value_type(m_arguments[argument]));
+}
+
+std::string_view FunctionContext::argument_text(int argument) {
+  const auto str = sqlite3_value_text(m_arguments[argument]);
+  const auto length = sqlite3_value_bytes(m_arguments[argument]);
+  return { reinterpret_cast<const char*>(str), static_cast<size_t>(length) };
+}
+
+nonstd::span<const std::byte> FunctionContext::argument_blob(int argument) {
+  const auto data = sqlite3_value_blob(m_arguments[argument]);
+  const auto length = sqlite3_value_bytes(m_arguments[argument]);
+  return { static_cast<const std::byte*>(data), static_cast<size_t>(length) };
+}
+
+void FunctionContext::result_null() {
+  sqlite3_result_null(m_context);
+}
+
+void FunctionContext::result(std::string_view string) {
+  sqlite3_result_text(m_context, string.data(),
+    static_cast<int>(string.size()), SQLITE_TRANSIENT);
+}
+
+void FunctionContext::result(nonstd::span<const std::byte> blob) {
+  sqlite3_result_blob(m_context, blob.data(),
+    static_cast<int>(blob.size()), SQLITE_TRANSIENT);
+}
+
+//-------------------------------------------------------------------------
+
 Database::Database(Database&& rhs) noexcept
-  : m_database(std::exchange(rhs.m_database, nullptr)) {
+  : m_database(std::exchange(rhs.m_database, nullptr)),
+    m_progress_handler(std::move(rhs.m_progress_handler)) {
 }
 
 Database& Database::operator=(Database&& rhs) noexcept {
   auto tmp = std::move(rhs);
   std::swap(tmp.m_database, m_database);
+  std::swap(tmp.m_progress_handler, m_progress_handler);
   return *this;
 }
 
@@ -207,6 +248,40 @@ Statement Database::prepare(std::string_view sql) {
   return Statement{ statement };
 }
 
+void Database::create_function(const std::string& name,
+    int argument_count, Function function) {
+  const auto call = [](sqlite3_context* context,
+      int argument_count, sqlite3_value** arguments) {
+    auto& function = *static_cast<Function*>(sqlite3_user_data(context));
+    auto function_context = FunctionContext(context, argument_count, arguments);
+    try {
+      function(function_context);
+    }
+    catch (const std::exception& ex) {
+      sqlite3_result_error(context, ex.what(), -1);
+    }
+  };
+  const auto destroy = [](void* function) {
+    delete static_cast<Function*>(function);
+  };
+  if (sqlite3_create_function_v2(m_database, name.c_str(), argument_count,
+      SQLITE_UTF8 | SQLITE_DETERMINISTIC, new Function(std::move(function)),
+      call, nullptr, nullptr, destroy))
+    error(m_database);
+}
+
+void Database::set_progress_handler(int instructions, ProgressHandler handler) {
+  if (!handler) {
+    sqlite3_progress_handler(m_database, 0, nullptr, nullptr);
+    m_progress_handler.reset();
+    return;
+  }
+  m_progress_handler = std::make_unique<ProgressHandler>(std::move(handler));
+  sqlite3_progress_handler(m_database, instructions, [](void* handler) {
+    return (*static_cast<ProgressHandler*>(handler))() ? 1 : 0;
+  }, m_progress_handler.get());
+}
+
 void Database::interrupt() {
   sqlite3_interrupt(m_database);
 }
@@ -215,4 +290,8 @@ int64_t Database::last_insert_rowid() {
   return sqlite3_last_insert_rowid(m_database);
 }
 
+int Database::total_changes() {
+  return sqlite3_total_changes(m_database);
+}
+
 } // namespace
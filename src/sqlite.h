@@ -1,12 +1,16 @@
 #pragma once
 
 #include "libs/nonstd/span.hpp"
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 struct sqlite3;
 struct sqlite3_stmt;
+struct sqlite3_context;
+struct sqlite3_value;
 
 namespace sqlite {
 
@@ -77,6 +81,33 @@ private:
 
 //-------------------------------------------------------------------------
 
+class FunctionContext {
+public:
+  int argument_count() const { return m_argument_count; }
+  Type argument_type(int argument) const;
+  std::string_view argument_text(int argument);
+  nonstd::span<const std::byte> argument_blob(int argument);
+  void result_null();
+  void result(std::string_view string);
+  void result(nonstd::span<const std::byte> blob);
+
+private:
+  friend class Database;
+  FunctionContext(sqlite3_context* context,
+    int argument_count, sqlite3_value** arguments);
+
+  sqlite3_context* m_context{ };
+  int m_argument_count{ };
+  sqlite3_value** m_arguments{ };
+};
+
+using Function = std::function<void(FunctionContext&)>;
+
+// returning true interrupts the running statement
+using ProgressHandler = std::function<bool()>;
+
+//-------------------------------------------------------------------------
+
 class Database {
 public:
   Database() = default;
@@ -88,11 +119,16 @@ public:
   void close();
   int execute(std::string_view sql);
   Statement prepare(std::string_view sql);
+  void create_function(const std::string& name, int argument_count,
+    Function function);
+  void set_progress_handler(int instructions, ProgressHandler handler);
   int64_t last_insert_rowid();
+  int total_changes();
   void interrupt();
 
 private:
   sqlite3* m_database{ };
+  std::unique_ptr<ProgressHandler> m_progress_handler;
 };
 
 } // namespace
@@ -5,6 +5,8 @@ class Backend {
   constructor (nativeClient) {
     this._filesystemRoot = undefined
     this._nativeClient = nativeClient
+    this._recordingOutputHandlers = new Map()
+    this._pollingRecordingOutput = false
   }
 
   async getRequiredVersion () {
@@ -71,7 +73,7 @@ class Backend {
     return this._filesystemRoot
   }
 
-  async startRecording (recorderId, path, url, handleOutput) {
+  async startRecording (recorderId, path, url, foreground, handleOutput) {
     const serveMode = await Utils.getSetting('default-serve-mode')
     const allowLossyCompression = await Utils.getSetting('allow-lossy-compression')
     const request = {
@@ -82,7 +84,8 @@ class Backend {
       serve: serveMode,
       archive: 'latest-and-first',
       allowLossyCompression: allowLossyCompression,
-      deterministic: true
+      deterministic: true,
+      foreground: foreground
     }
     await this._nativeClient.sendRequest(request)
     this._pollRecordingOutput(recorderId, handleOutput)
@@ -96,6 +99,21 @@ class Backend {
     return this._nativeClient.sendRequest(request)
   }
 
+  async prioritizeRecording (recorderId) {
+    const request = {
+      action: 'prioritizeRecording',
+      id: recorderId
+    }
+    return this._nativeClient.sendRequest(request)
+  }
+
+  async getRecorders () {
+    const request = {
+      action: 'getRecorders'
+    }
+    return this._nativeClient.sendRequest(request)
+  }
+
   async getFileSize (path) {
     const request = {
       action: 'getFileSize',
@@ -110,7 +128,7 @@ class Backend {
       from: sourcePath,
       to: targetPath
     }
-    return this._nativeClient.sendRequest(request)
+    return this._waitForFileOperation(await this._nativeClient.sendRequest(request))
   }
 
   async deleteFile (path, undeleteId) {
@@ -119,7 +137,7 @@ class Backend {
       path: path,
       undeleteId: undeleteId
     }
-    return this._nativeClient.sendRequest(request)
+    return this._waitForFileOperation(await this._nativeClient.sendRequest(request))
   }
 
   async undeleteFile (undeleteId) {
@@ -127,9 +145,33 @@ class Backend {
       action: 'undeleteFile',
       undeleteId: undeleteId
     }
+    return this._waitForFileOperation(await this._nativeClient.sendRequest(request))
+  }
+
+  async cancelFileOperation (jobId) {
+    const request = {
+      action: 'cancelFileOperation',
+      jobId: jobId
+    }
     return this._nativeClient.sendRequest(request)
   }
 
+  async _waitForFileOperation (response) {
+    // file operations are executed in the background,
+    // the request fails when the operation failed
+    const request = {
+      action: 'getFileOperation',
+      jobId: response.jobId
+    }
+    for (;;) {
+      const job = await this._nativeClient.sendRequest(request)
+      if (job.state !== 'queued' && job.state !== 'running') {
+        return job
+      }
+      await Utils.sleep(100)
+    }
+  }
+
   async browserDirectories (initialPath) {
     const request = {
       action: 'browserDirectories',
@@ -155,17 +197,20 @@ class Backend {
     return this._nativeClient.sendRequest(request)
   }
 
-  async executeSearch (query, forSearchPage) {
+  async executeSearch (query, forSearchPage, offset, filter) {
     // replace space with *
     query = (query + ' ').replace(/\s+/g, '*')
 
     const request = {
       action: 'executeSearch',
-      query: query
+      query: query,
+      session: (forSearchPage ? 'searchPage' : 'omnibox'),
+      ...filter
     }
     if (forSearchPage) {
       request.highlight = true
       request.snippetSize = 32
+      request.offset = offset || 0
       request.maxCount = 20
     }
     return this._nativeClient.sendRequest(request)
@@ -202,25 +247,63 @@ class Backend {
     return this._nativeClient.sendRequest(request)
   }
 
-  async _pollRecordingOutput (recorderId, handleOutput) {
+  _pollRecordingOutput (recorderId, handleOutput) {
+    this._recordingOutputHandlers.set(recorderId, handleOutput)
+    if (!this._pollingRecordingOutput) {
+      this._pollAllRecordingOutput()
+    }
+  }
+
+  async _pollAllRecordingOutput () {
+    // a single request for the output of all recorders
     const request = {
-      action: 'getRecordingOutput',
-      id: recorderId
+      action: 'getAllRecordingOutput'
     }
-    for (;;) {
-      const response = await this._nativeClient.sendRequest(request)
-      if (!response.events) {
-        await handleOutput()
-        break
-      }
-      for (const event of response.events) {
-        try {
-          await handleOutput(event)
-        } catch (ex) {
-          console.error('unhandled exception in output handling:', ex.message)
+    this._pollingRecordingOutput = true
+    try {
+      while (this._recordingOutputHandlers.size > 0) {
+        const polled = new Map(this._recordingOutputHandlers)
+        const response = await this._nativeClient.sendRequest(request)
+        for (const recording of response.recordings) {
+          const handleOutput = polled.get(recording.id)
+          if (handleOutput) {
+            polled.delete(recording.id)
+            await this._handleRecordingOutput(recording, handleOutput)
+          }
+        }
+        // recorders which finished or failed to start
+        for (const recorderId of response.finished) {
+          polled.set(recorderId, this._recordingOutputHandlers.get(recorderId))
+        }
+        for (const [recorderId, handleOutput] of polled) {
+          if (this._recordingOutputHandlers.delete(recorderId)) {
+            await handleOutput()
+          }
         }
+        await Utils.sleep(250)
+      }
+    } finally {
+      this._pollingRecordingOutput = false
+    }
+  }
+
+  async _handleRecordingOutput (recording, handleOutput) {
+    if (recording.droppedEvents) {
+      console.warn('recording output dropped', recording.droppedEvents, 'events')
+    }
+    for (const event of recording.events) {
+      try {
+        await handleOutput(event)
+      } catch (ex) {
+        console.error('unhandled exception in output handling:', ex.message)
+      }
+    }
+    for (const [type, status, size, url] of recording.eventFrames || []) {
+      try {
+        await handleOutput({ type, status, size, url })
+      } catch (ex) {
+        console.error('unhandled exception in output handling:', ex.message)
       }
-      await Utils.sleep(250)
     }
   }
 }
@@ -19,6 +19,7 @@ class BookmarkLibrary {
     browser.bookmarks.onRemoved.addListener((id, info) => this._handleBookmarkRemoved(id, info))
     browser.bookmarks.onMoved.addListener((id, info) => this._handleBookmarkMoved(id, info))
     browser.tabs.onRemoved.addListener((id) => this._handleTabRemoved(id))
+    browser.tabs.onActivated.addListener((info) => this._handleTabActivated(info))
     browser.webRequest.onBeforeRequest.addListener(
       async (details) => this._handleBeforeRequest(details),
       { urls: ['http://*/*', 'https://*/*'] }, ['blocking'])
@@ -196,6 +197,7 @@ class BookmarkLibrary {
       localHostname: null,
       tabIds: [initialTabId],
       finishing: false,
+      queued: false,
       events: [],
       onFinished: [],
       onEvent: []
@@ -204,8 +206,9 @@ class BookmarkLibrary {
     this._recorderByTabId[initialTabId] = recorder
 
     const { path, inLibrary } = await this.getBookmarkPath(bookmark.id)
+    const foreground = await this._isActiveTab(initialTabId)
     await this._backend.startRecording(
-      recorder.recorderId, path, bookmark.url,
+      recorder.recorderId, path, bookmark.url, foreground,
       event => this._handleRecordingOutput(recorder, event))
 
     return recorder
@@ -242,21 +245,36 @@ class BookmarkLibrary {
     DEBUG('webrecorder', event)
     if (!event) {
       await this._handleRecordingFinished(recorder)
+    } else if (typeof event !== 'string') {
+      // structured event of the event channel
+      await this._dispatchRecordingEvent(recorder, event)
+    } else if (event === 'QUEUED') {
+      DEBUG('recording queued', recorder.url.href)
+      recorder.queued = true
+    } else if (event === 'STARTING') {
+      recorder.queued = false
+      await this._dispatchRecordingEvent(recorder, event)
+    } else if (event.startsWith('LIMIT_EXCEEDED ')) {
+      console.warn('recording', recorder.url.href, 'stopped, exceeded', event.substring(15), 'limit')
     } else if (event.startsWith('ACCEPT ')) {
       await this._handleRecordingStarted(recorder, event.substring(7))
     } else if (event.startsWith('REDIRECT ')) {
       await this._handleRecordingRedirected(recorder, event.substring(9))
     } else {
-      recorder.events.push(event)
-      for (let i = 0; i < recorder.onEvent.length;) {
-        try {
-          const handler = recorder.onEvent[i]
-          await handler(event)
-          ++i
-        } catch (ex) {
-          recorder.onEvent.splice(i, 1)
-          DEBUG('recording output handler failed: ', ex)
-        }
+      await this._dispatchRecordingEvent(recorder, event)
+    }
+  }
+
+  async _dispatchRecordingEvent (recorder, event) {
+    recorder.events.push(event)
+    for (let i = 0; i < recorder.onEvent.length;) {
+      try {
+        const handler = recorder.onEvent[i]
+        await handler(event)
+        ++i
+      } catch (ex) {
+        recorder.onEvent.splice(i, 1)
+        DEBUG('recording output handler failed: ', ex)
       }
     }
   }
@@ -353,6 +371,22 @@ class BookmarkLibrary {
     }
   }
 
+  async _isActiveTab (tabId) {
+    try {
+      return (await browser.tabs.get(tabId)).active
+    } catch {
+      return false
+    }
+  }
+
+  async _handleTabActivated ({ tabId }) {
+    // let queued recording of the foreground tab start next
+    const recorder = this._recorderByTabId[tabId]
+    if (recorder && recorder.queued && !recorder.localUrl) {
+      await this._backend.prioritizeRecording(recorder.recorderId)
+    }
+  }
+
   async _handleTabRemoved (id) {
     await this._stopRecordingInTab(id)
     setTimeout(() => { this._purgeTemporarilyBypassedBookmarks() }, 100)
@@ -524,7 +558,10 @@ class BookmarkLibrary {
         recorder = await this._startRecordingInTab(bookmark.id, originalUrl, tabId)
         for (let i = 0; !recorder.localUrl; ++i) {
           await Utils.sleep(10)
-          if (i === 1000) {
+          // timeout starts once a queued recording is started
+          if (recorder.queued) {
+            i = 0
+          } else if (i >= 1000) {
             console.error('Starting recorder timed out')
             return { cancel: true }
           }
@@ -89,13 +89,17 @@ function addTreeNode (url, isLeaf, size, status) {
 
 function handleRecordingEvent (event) {
   const { type, status, size, url } = (function () {
+    if (typeof event !== 'string') {
+      return event
+    }
     const p = event.split(' ')
     if (p[0] === 'DOWNLOAD_FINISHED') {
       return { type: p[0], status: p[1], size: p[2], url: p[3] }
     }
     return { type: p[0], url: p[1] }
   })()
-  if (type === 'STARTING' || type === 'FINISHED') {
+  if (type === 'STARTING' || type === 'QUEUED' || type === 'LIMIT_EXCEEDED' ||
+      type === 'FINISHED') {
     return
   }
   addTreeNode((url || "").trim(), true, size, type)
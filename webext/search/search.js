@@ -2,13 +2,24 @@
 
 let backend
 
-async function executeSearch () {
+async function executeSearch (offset) {
   const urlParams = new URLSearchParams(window.location.search)
   const query = urlParams.get('s')
   if (!query) {
     return
   }
-  const response = await backend.executeSearch(query, true)
+  // optionally restrict search to a folder (separated by /) or a host
+  const filter = {}
+  if (urlParams.get('folder')) {
+    filter.folder = urlParams.get('folder').split('/').filter(Boolean)
+  }
+  if (urlParams.get('host')) {
+    filter.hostname = urlParams.get('host')
+  }
+  const response = await backend.executeSearch(query, true, offset, filter)
+  if (response.cancelled) {
+    return
+  }
   const results = document.createDocumentFragment()
 
   if (response.matches.length > 0) {
@@ -60,18 +71,38 @@ async function executeSearch () {
       results.appendChild(result)
     }
   }
-  else {
+  else if (!offset) {
     results.textContent = browser.i18n.getMessage('search_no_results')
   }
+
+  // append next page of ranked matches on demand
+  const nextOffset = offset + response.matches.length
+  if (response.matches.length > 0 && nextOffset < response.totalCount) {
+    const moreLink = document.createElement('a')
+    moreLink.id = 'more-results'
+    moreLink.setAttribute('href', '#')
+    moreLink.textContent = browser.i18n.getMessage('search_more_results',
+      [String(response.totalCount - nextOffset) +
+       (response.totalCountExact ? '' : '+')])
+    moreLink.addEventListener('click', event => {
+      event.preventDefault()
+      moreLink.remove()
+      executeSearch(nextOffset)
+    })
+    results.appendChild(moreLink)
+  }
+
   const resultsElement = document.getElementById('results')
-  resultsElement.textContent = ''
+  if (!offset) {
+    resultsElement.textContent = ''
+  }
   resultsElement.appendChild(results)
 }
 
 browser.runtime.getBackgroundPage().then(background => {
   backend = background.getBackend()
 
-  executeSearch()
+  executeSearch(0)
 })
 
 document.getElementById('search-input').value =